@@ -0,0 +1,128 @@
+// Copyright (c) 2023 Otto Link. Distributed under the terms of the
+// GNU General Public License. The full license is in the file
+// LICENSE, distributed with this software.
+#pragma once
+#include <cstddef>
+#include <vector>
+
+#include "core/array.hpp"
+#include "core/gerstner.hpp"
+
+#define TILE_COARSE -1
+#define TILE_LAND -2
+
+// full resolution tile of the shore band, nodes [i0, i0 + n0) x [j0, j0 +
+// n1) where (n0, n1) is the shape of the fields (one node overlap with
+// the next tiles, node indices wrap around in periodic mode)
+struct ShoreTile
+{
+  int   i0;
+  int   j0;
+  Array shore_dist = Array({0, 0});
+  Array phi_depth = Array({0, 0});
+  Array x_disp = Array({0, 0});
+  Array y_disp = Array({0, 0});
+  Array dz_disp = Array({0, 0});
+};
+
+// Two-level representation of the waves for large domains. The whole
+// model runs on a grid coarsened by 'coarsening' ('coarse', which also
+// holds the wave parameters), and only the tiles of the shore band are
+// evaluated at full resolution: the tiles with both land and water
+// cells, and the tiles where the coarse shore distance is below
+// 'band_threshold'. The elevation is resampled on the full resolution
+// grid by 'generate', open water being interpolated from the coarse
+// grid.
+//
+// On the tiles, the shore distance is exact up to 'halo' cells from the
+// shore (larger distances are interpolated from the coarse level). The
+// phase lag, an integral of the depth along the wave direction, is
+// integrated at full resolution tile by tile from upstream, seeded at
+// the upstream tile edges by the refined neighbours, by the coarse level
+// in open water, and across land tiles by the (constant) land excess.
+// The deep water detail of 'coarse.p_spectral' (if any) is added at full
+// resolution.
+class AdaptiveWave
+{
+public:
+  std::vector<int> shape;
+  Array           *p_h = nullptr; // full resolution water depth
+  Array            dz = Array({0, 0});
+  int              coarsening = 4;
+  int              tile_size = 32;
+  int              halo = 8;
+  float            band_threshold = 0.5f;
+
+  // coarse level (water depth sampled from 'p_h')
+  Array        coarse_h = Array({0, 0});
+  GerstnerWave coarse;
+
+  AdaptiveWave(Array &h, bool update = true) : coarse(coarse_h, false)
+  {
+    this->shape = h.shape;
+    this->p_h = &h;
+    if (update)
+      this->update();
+  }
+
+  // 'coarse' points to 'coarse_h'
+  AdaptiveWave(const AdaptiveWave &) = delete;
+
+  AdaptiveWave &operator=(const AdaptiveWave &) = delete;
+
+  void update();
+
+  void generate(float t);
+
+  // evaluate the elevation directly in a caller-owned buffer, strides
+  // are in bytes (see 'GerstnerWave::generate')
+  void generate(float t, float *p_out, ptrdiff_t stride_i, ptrdiff_t stride_j);
+
+  // fraction of the cells evaluated at full resolution
+  float refined_fraction() const;
+
+  // private:
+  std::vector<int>       coarse_shape;
+  std::vector<ShoreTile> tiles;
+
+  // tile partition, index in 'tiles' for the refined tiles,
+  // TILE_COARSE (open water) or TILE_LAND otherwise
+  int              nti = 0;
+  int              ntj = 0;
+  std::vector<int> tile_index;
+
+  // integration order of the refined tiles (upstream first), the tiles
+  // of a same level are independent
+  std::vector<int> tile_level;
+
+  void update_coarse_depth();
+
+  void update_tiles();
+
+  void update_tile_fields(ShoreTile &tile);
+
+  // full resolution phase lag of the tile, the tiles of lower levels
+  // being done
+  void integrate_tile_phase_lag(ShoreTile &tile);
+
+  // phase lag at the full resolution node (u, v) from the tiles of a
+  // level below 'level', traced back across the land tiles, or from the
+  // coarse level ('depth' bounds the tracing)
+  float phase_lag(float u, float v, int level, int depth = 0) const;
+
+  void displace_tile(ShoreTile &tile, float t);
+
+  // coarse grid coordinates of the full resolution node (u, v)
+  void to_coarse(float u, float v, float &uc, float &vc) const;
+
+  // deep water detail of 'coarse.p_spectral', see
+  // 'GerstnerWave::add_spectral'
+  void add_spectral(float     t,
+                    float    *p_out,
+                    ptrdiff_t stride_i,
+                    ptrdiff_t stride_j);
+
+  // Lagrangian elevation at the full resolution node (u, v), from the
+  // refined tiles or from the coarse level
+  float sample_dz_disp(float u, float v) const;
+};
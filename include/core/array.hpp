@@ -5,41 +5,120 @@
 #include <iostream>
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <cstdint>
+#include <mutex>
 #include <random>
+#include <utility>
 #include <vector>
 
-#include <GLFW/glfw3.h>
+// run of cells [j1, j2) on row i
+struct CellSpan
+{
+  int i;
+  int j1;
+  int j2;
+};
+
+// summary statistics, computed in a single (parallel) pass
+struct ArrayStats
+{
+  float min;
+  float max;
+  float mean;
+};
 
+// The statistics (and histogram) are cached and invalidated by any
+// write access: reshaping, non-const element access or non-const
+// 'data()' (the cache is cleared when the access is granted, not when
+// the writes are done: the statistics should not be queried while
+// writing through a pointer obtained earlier). Reads through a const
+// array leave the cache untouched. Inner loops should access the
+// elements through a row pointer ('&array(i, 0)') to remain
+// vectorizable. The statistics can be queried concurrently, but not
+// concurrently with writes to the array.
 class Array
 {
 public:
-  std::vector<int>   shape;
-  std::vector<float> vector;
+  std::vector<int> shape;
 
   Array(std::vector<int> shape)
   {
     this->set_shape(shape);
   }
 
+  Array(const Array &other)
+      : shape(other.shape), vector(other.vector),
+        stats_valid(other.stats_valid.load()), stats(other.stats),
+        hist(other.hist)
+  {
+  }
+
+  Array(Array &&other)
+      : shape(std::move(other.shape)), vector(std::move(other.vector)),
+        stats_valid(other.stats_valid.load()), stats(other.stats),
+        hist(std::move(other.hist))
+  {
+  }
+
+  Array &operator=(const Array &other)
+  {
+    this->shape = other.shape;
+    this->vector = other.vector;
+    this->stats_valid = other.stats_valid.load();
+    this->stats = other.stats;
+    this->hist = other.hist;
+    return *this;
+  }
+
+  Array &operator=(Array &&other)
+  {
+    this->shape = std::move(other.shape);
+    this->vector = std::move(other.vector);
+    this->stats_valid = other.stats_valid.load();
+    this->stats = other.stats;
+    this->hist = std::move(other.hist);
+    return *this;
+  }
+
   inline std::vector<int> get_shape()
   {
     return shape;
   }
 
-  std::vector<float> get_vector()
+  const std::vector<float> &get_vector() const
   {
     return this->vector;
   }
 
+  size_t size() const
+  {
+    return this->vector.size();
+  }
+
+  // row-major values, the non-const access invalidates the statistics
+  float *data()
+  {
+    this->invalidate_stats();
+    return this->vector.data();
+  }
+
+  const float *data() const ///< @overload
+  {
+    return this->vector.data();
+  }
+
   void set_shape(std::vector<int> new_shape)
   {
     this->shape = new_shape;
     this->vector.resize(this->shape[0] * this->shape[1]);
+    this->invalidate_stats();
   }
 
   float &operator()(int i, int j)
   {
+    this->invalidate_stats();
     return this->vector[i * this->shape[1] + j];
   }
 
@@ -48,27 +127,85 @@ public:
     return this->vector[i * this->shape[1] + j];
   }
 
+  ArrayStats get_stats() const;
+
+  // number of values in 'nbins' bins evenly spanning [min, max]
+  std::vector<int> histogram(int nbins) const;
+
   float max() const
   {
-    return *std::max_element(this->vector.begin(), this->vector.end());
+    return this->get_stats().max;
+  }
+
+  float mean() const
+  {
+    return this->get_stats().mean;
   }
 
   float min() const
   {
-    return *std::min_element(this->vector.begin(), this->vector.end());
+    return this->get_stats().min;
   }
 
-  std::vector<uint8_t> to_img_8bit_grayscale();
+  std::vector<uint8_t> to_img_8bit_grayscale() const;
 
-  std::vector<uint8_t> to_img_8bit_rgb(Array *p_mask = nullptr);
+  std::vector<uint8_t> to_img_8bit_rgb(const Array *p_mask = nullptr) const;
 
-  void to_texture(GLuint &image_texture, int colormap, Array *p_mask = nullptr);
+private:
+  std::vector<float> vector;
+
+  // statistics cache, computed under 'stats_mutex'
+  mutable std::atomic<bool> stats_valid{false};
+  mutable ArrayStats        stats;
+  mutable std::vector<int>  hist; // empty if outdated
+  mutable std::mutex        stats_mutex;
+
+  // the flag is read first so that concurrent writers (e.g. the threads
+  // of a parallel loop) do not contend on it once cleared
+  void invalidate_stats()
+  {
+    if (this->stats_valid.load(std::memory_order_relaxed))
+      this->stats_valid.store(false, std::memory_order_relaxed);
+  }
+
+  // statistics computed if outdated, 'stats_mutex' being held
+  void update_stats() const;
 };
 
-Array distance_transform(const Array &array);
-Array gradient_angle(const Array &array);
-Array gradient_x(const Array &array);
-Array gradient_y(const Array &array);
+Array distance_transform(const Array &array, bool periodic = false);
+
+// same, the intermediate row distances 'g' being kept for subsequent
+// calls to 'distance_transform_update'
+Array distance_transform(const Array &array, Array &g, bool periodic = false);
+
+// incremental update after the array has been modified on rows [i1,
+// i2) only, in two steps: the row distances 'g' of these rows are
+// rescanned, returning the columns where they have changed in [j1, j2)
+// (empty range if none), then each of these columns of the squared
+// distance 'dt' is rescanned on the rows where it can change only,
+// returned in [u1, u2) (to be taken modulo the number of rows in
+// periodic mode)
+void distance_transform_update_rows(const Array &array,
+                                    Array       &g,
+                                    int          i1,
+                                    int          i2,
+                                    bool         periodic,
+                                    int         &j1,
+                                    int         &j2);
+
+void distance_transform_update_column(const Array &g,
+                                      Array       &dt,
+                                      int          j,
+                                      int          i1,
+                                      int          i2,
+                                      bool         periodic,
+                                      int         &u1,
+                                      int         &u2);
+
+Array gradient_angle(const Array &array, bool periodic = false);
+Array gradient_x(const Array &array, bool periodic = false);
+Array gradient_y(const Array &array, bool periodic = false);
+Array laplacian(const Array &array, bool periodic = false);
 Array interp_nearest(const Array &x,
                      const Array &y,
                      const Array &z,
@@ -0,0 +1,23 @@
+// Copyright (c) 2023 Otto Link. Distributed under the terms of the
+// GNU General Public License. The full license is in the file
+// LICENSE, distributed with this software.
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// BC4 (one channel) and BC5 (two channels) block compression. Input
+// planes are row-major (width x height) with values in [0, 1], the
+// dimensions do not need to be multiples of 4 (partial blocks are
+// padded with the nearest texels).
+
+// encode a 4x4 block (16 values, row-major) into 8 bytes
+void encode_bc4_block(const float *p_values, uint8_t *p_block);
+
+std::vector<uint8_t> compress_bc4(const std::vector<float> &plane,
+                                  int                       width,
+                                  int                       height);
+
+std::vector<uint8_t> compress_bc5(const std::vector<float> &plane_r,
+                                  const std::vector<float> &plane_g,
+                                  int                       width,
+                                  int                       height);
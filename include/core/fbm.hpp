@@ -12,4 +12,5 @@ Array fbm_perlin(std::vector<int>   shape,
                  float              weight,
                  float              persistence,
                  float              lacunarity,
-                 std::vector<float> shift = {0.f, 0.f});
+                 std::vector<float> shift = {0.f, 0.f},
+                 bool               periodic = false);
@@ -0,0 +1,45 @@
+// Copyright (c) 2023 Otto Link. Distributed under the terms of the
+// GNU General Public License. The full license is in the file
+// LICENSE, distributed with this software.
+#pragma once
+#include <complex>
+#include <vector>
+
+#include "core/array.hpp"
+
+// columns transformed together in the column pass of 'irfft2d'
+#define FFT_COLUMN_BLOCK 8
+
+bool is_power_of_two(int n);
+
+// In-place complex FFT of a power of two size, radix-4 stages (preceded
+// by a radix-2 stage for odd powers of two) on bit-reversed input. The
+// forward transform uses exp(-2 i pi k n / N), the inverse transform is
+// not normalized.
+class FFTPlan
+{
+public:
+  int n;
+
+  FFTPlan(int n);
+
+  void execute(std::complex<float> *p_data, bool inverse = false) const;
+
+private:
+  int                              log2n;
+  std::vector<int>                 bit_reversal;
+  std::vector<std::complex<float>> twiddle; // exp(-2 i pi k / n), k < n / 2
+};
+
+// Real field of shape (ni, nj) (powers of two, nj >= 2) from its half
+// spectrum (row-major, shape (ni, nj / 2 + 1), frequencies in FFT order),
+// not normalized: x(i, j) = sum X(p, q) exp(2 i pi (p i / ni + q j /
+// nj)) over the full Hermitian spectrum. The columns are transformed by
+// blocks of FFT_COLUMN_BLOCK and the rows with a half-size complex FFT,
+// with the plans 'plan_i' (size ni) and 'plan_j' (size nj / 2) built by
+// the caller once for all the transforms of this shape. 'spectrum' is
+// used as a work buffer and overwritten.
+void irfft2d(std::vector<std::complex<float>> &spectrum,
+             Array                            &out,
+             const FFTPlan                    &plan_i,
+             const FFTPlan                    &plan_j);
@@ -0,0 +1,16 @@
+// Copyright (c) 2023 Otto Link. Distributed under the terms of the
+// GNU General Public License. The full license is in the file
+// LICENSE, distributed with this software.
+#pragma once
+#include <string>
+
+#include "core/gerstner.hpp"
+
+// Samples exactly one wave period (2 pi / omega) into 'nframes' frames
+// (seamless loop) and exports them as block-compressed DDS texture
+// arrays: '<basename>_height.dds' (BC4, elevation mapped from [-r, r]
+// to [0, 1]) and '<basename>_normal.dds' (BC5, normal x and y
+// components mapped from [-1, 1] to [0, 1]). Texels follow the GUI
+// convention, with (i, j) used as (x, y) and (0, 0) at the bottom
+// left. Returns false if a file cannot be written.
+bool export_flipbook(GerstnerWave &wave, int nframes, std::string basename);
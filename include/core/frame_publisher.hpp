@@ -0,0 +1,158 @@
+// Copyright (c) 2023 Otto Link. Distributed under the terms of the
+// GNU General Public License. The full license is in the file
+// LICENSE, distributed with this software.
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "core/array.hpp"
+#include "core/gerstner.hpp"
+
+// Elevation frames shared with other processes through a POSIX
+// shared-memory ring buffer. Memory layout: a FrameRingHeader (padded to
+// FRAME_RING_HEADER_SIZE bytes) followed by 'nslots' slots of
+// 'slot_size' bytes, each slot being a FrameSlotHeader (padded to
+// FRAME_SLOT_HEADER_SIZE bytes) followed by the ni x nj elevation values
+// (float, row-major).
+//
+// Lock-free protocol (seqlock per slot): the publisher makes the slot
+// sequence number odd, writes the slot, makes it even again and then
+// increments 'nframes'. Readers access the data in place and check that
+// the sequence number is even and unchanged afterwards. The publisher
+// never waits for the readers, a reader slower than 'nslots' frames only
+// gets its frame invalidated.
+
+#define FRAME_RING_MAGIC 0x52465753 // "SWFR"
+#define FRAME_RING_VERSION 1
+#define FRAME_RING_HEADER_SIZE 64
+#define FRAME_SLOT_HEADER_SIZE 64
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2,
+              "lock-free 64-bit atomics are required in shared memory");
+
+struct FrameRingHeader
+{
+  uint32_t              magic;
+  uint32_t              version;
+  int32_t               ni;
+  int32_t               nj;
+  uint32_t              nslots;
+  std::atomic<uint32_t> closed; // set when the ring is dropped
+  uint64_t              slot_size;
+  std::atomic<uint64_t> nframes; // latest frame index is nframes - 1
+};
+
+struct FrameSlotHeader
+{
+  std::atomic<uint64_t> seq; // odd while being written
+  uint64_t              frame_index;
+  uint64_t              params_hash;
+  float                 t;
+};
+
+// publisher side, 'open' fails if the name is already in use (another
+// publisher, or a ring left over by a crashed one). The shared-memory
+// object is removed on 'close', unless the name has been reused since
+class FramePublisher
+{
+public:
+  FramePublisher() = default;
+
+  FramePublisher(const FramePublisher &) = delete;
+
+  FramePublisher &operator=(const FramePublisher &) = delete;
+
+  ~FramePublisher();
+
+  // 'name' is a POSIX shared-memory name ("/name")
+  bool open(std::string name, std::vector<int> shape, int nslots = 4);
+
+  void close();
+
+  bool is_open() const
+  {
+    return this->p_header != nullptr;
+  }
+
+  // copies a frame in the next slot, the ring is recreated with the
+  // same name if the shape has changed
+  bool publish(const Array &dz, float t, uint64_t params_hash);
+
+  // evaluates the wave elevation directly in the next slot
+  bool publish(GerstnerWave &wave, float t, uint64_t params_hash);
+
+private:
+  std::string      name;
+  int              nslots = 0;
+  size_t           size = 0;
+  uint64_t         dev = 0; // identity of the shared-memory object
+  uint64_t         ino = 0;
+  FrameRingHeader *p_header = nullptr;
+
+  bool ensure_shape(const std::vector<int> &shape);
+
+  float *begin_write(FrameSlotHeader *&p_slot,
+                     uint64_t         &seq,
+                     float             t,
+                     uint64_t          params_hash);
+
+  void end_write(FrameSlotHeader *p_slot, uint64_t seq);
+};
+
+// in-place view of a published frame
+struct FrameView
+{
+  const float *p_data = nullptr;
+  int          ni = 0;
+  int          nj = 0;
+  uint64_t     frame_index = 0;
+  uint64_t     params_hash = 0;
+  float        t = 0.f;
+
+  const FrameSlotHeader *p_slot = nullptr;
+  uint64_t               seq = 0;
+};
+
+// reader side (read-only mapping)
+class FrameSubscriber
+{
+public:
+  FrameSubscriber() = default;
+
+  FrameSubscriber(const FrameSubscriber &) = delete;
+
+  FrameSubscriber &operator=(const FrameSubscriber &) = delete;
+
+  ~FrameSubscriber();
+
+  bool open(std::string name);
+
+  void close();
+
+  bool is_open() const
+  {
+    return this->p_header != nullptr;
+  }
+
+  // true if the publisher has dropped the ring (closed, or recreated it
+  // for a new shape), the subscriber should then be reopened
+  bool is_stale() const;
+
+  // latest complete frame, in place (no copy), returns false if there
+  // is none yet
+  bool acquire(FrameView &view) const;
+
+  // returns false if the frame has been overwritten since 'acquire', in
+  // which case the values read in between must be discarded
+  bool validate(const FrameView &view) const;
+
+  // copy of the latest complete frame
+  bool read(std::vector<float> &data, FrameView &view) const;
+
+private:
+  size_t                 size = 0;
+  const FrameRingHeader *p_header = nullptr;
+};
@@ -3,12 +3,19 @@
 // LICENSE, distributed with this software.
 #pragma once
 #define _USE_MATH_DEFINES
+#include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
-
-#include "Interpolate.hpp"
+#include <vector>
 
 #include "core/array.hpp"
+#include "core/hash.hpp"
+#include "core/task_graph.hpp"
+
+class SpectralOcean;
 
 class GerstnerWave
 {
@@ -27,23 +34,147 @@ public:
   float            k_clipping_ratio = 4.f;
   float            shore_dist_ratio = 0.8f;
   float            shore_r_ratio = 0.9f;
+  float            open_water_eps = 1e-4f; // 1 - shore_dist threshold
+  bool             periodic = false;       // tileable domain
+
+  // optional cancellation flag, checked between the stages of 'update'
+  // (the fields are left partially updated when cancelled)
+  const std::atomic<bool> *p_cancel = nullptr;
 
-  GerstnerWave(Array &h)
+  // optional deep water detail, added to the elevation by 'generate'
+  // with a weight 'shore_dist' (no contribution at the shore)
+  SpectralOcean *p_spectral = nullptr;
+
+  GerstnerWave(Array &h, bool update = true)
   {
     this->shape = h.shape;
     this->p_h = &h;
-    this->update();
+    if (update)
+      this->update();
   }
 
   void update();
 
+  // completes an update when 'shore_dist' and 'phi_depth' are already
+  // known (e.g. restored from a cache), only the cheap stages are run
+  void update_from_fields();
+
+  // local update after the water depth has been modified on the cells
+  // [i1, i2) x [j1, j2) only (e.g. a brush stroke): the shore distance
+  // and the phase lag are only recomputed where the modification can
+  // affect them. Falls back to 'update' if the shape or the parameters
+  // have changed since the last update
+  void update_region(int i1, int i2, int j1, int j2);
+
+  // rebuilds the intermediate fields of 'update_region' only (e.g. after
+  // the other fields have been restored from a cache): 'shore_dist',
+  // 'phi_depth' and the active cells are left untouched
+  void update_region_fields();
+
+  // exchanges the intermediate fields of 'update_region' and their key
+  // with 'other' (same shape, depth and parameters)
+  void swap_region_fields(GerstnerWave &other);
+
+  // adds the update stages to a task graph, 'depth_tasks' are the tasks
+  // producing the water depth (if any)
+  void add_update_tasks(TaskGraph &graph, std::vector<int> depth_tasks = {});
+
   void generate(float t);
 
+  // evaluate the elevation directly in a caller-owned buffer, strides
+  // are in bytes: element (i, j) is stored at p_out + i * stride_i + j *
+  // stride_j
+  void generate(float t, float *p_out, ptrdiff_t stride_i, ptrdiff_t stride_j);
+
+  // evaluate the Gerstner surface itself (Lagrangian description): the
+  // displaced positions 'x_disp', 'y_disp' and the elevation 'dz_disp'
+  // at these positions, without resampling on the grid
+  void displace(float t);
+
   // private:
   float r;
   float omega;
   Array phi_depth = Array({0, 0});
   Array shore_dist = Array({0, 0});
+
+  // active cells: shore band (full model) and open water (analytic
+  // model), land cells are never evaluated
+  std::vector<CellSpan> spans_land;
+  std::vector<CellSpan> spans_shore;
+  std::vector<CellSpan> spans_open;
+
+  // displaced positions and elevation before resampling
+  Array x_disp = Array({0, 0});
+  Array y_disp = Array({0, 0});
+  Array dz_disp = Array({0, 0});
+
+  // intermediate fields kept for 'update_region', valid if 'region_key'
+  // matches the current shape and parameters (0 if unknown): squared
+  // distance to the shore and its row pass, wavenumber excess and phase
+  // lag on the rotated grid (wavenumber excess on the main grid, phase
+  // lag along the lines and its drift per step in periodic mode)
+  uint64_t           region_key = 0;
+  Array              dt = Array({0, 0});
+  Array              dt_g = Array({0, 0});
+  Array              fk = Array({0, 0});
+  Array              phi_depth_r = Array({0, 0});
+  std::vector<float> phi_lines;
+  std::vector<float> phi_drift;
+
+  void update_grid();
+
+  void update_shore_distance();
+
+  void update_phase_lag();
+
+  void update_phase_lag_periodic();
+
+  // integration stages of the above, up to the rotated grid (or the
+  // lines in periodic mode)
+  void update_phase_lag_rotated();
+
+  void update_phase_lag_lines();
+
+  void update_active_cells();
+
+  // incremental counterparts, the rows with cells changing type (land,
+  // shore band or open water) are flagged in 'rows'
+  void update_shore_distance_region(int i1, int i2, std::vector<char> &rows);
+
+  void update_phase_lag_region(int i1, int i2, int j1, int j2);
+
+  void update_phase_lag_periodic_region(int i1, int i2, int j1, int j2);
+
+  void update_active_cells_rows(const std::vector<char> &rows);
+
+  void append_row_spans(int                    i,
+                        std::vector<CellSpan> &land,
+                        std::vector<CellSpan> &shore,
+                        std::vector<CellSpan> &open) const;
+
+  uint64_t get_region_key() const;
+
+  // elevation at the grid nodes from the displaced surface
+  void resample(float *p_out, ptrdiff_t stride_i, ptrdiff_t stride_j);
+
+  // synthesizes the deep water field at time 't' and adds it to the
+  // water cells, weighted by 'shore_dist'
+  void add_spectral(float     t,
+                    float    *p_out,
+                    ptrdiff_t stride_i,
+                    ptrdiff_t stride_j);
+
+  // wave vector, snapped to integer components in periodic mode
+  void wave_vector(float &kx, float &ky) const;
+
+  // phase drift removed per unit length along the wave direction at the
+  // grid position (u, v), periodic mode only
+  float phase_drift(float u, float v) const;
+
+  bool cancelled() const
+  {
+    return this->p_cancel and this->p_cancel->load();
+  }
 };
 
 class WaterDepth
@@ -65,10 +196,17 @@ public:
   float offset = -0.5f;
   float scaling = 0.4f;
 
-  WaterDepth(std::vector<int> shape) : shape(shape)
+  // tileable domain (the slope is then ignored since it is not periodic)
+  bool periodic = false;
+
+  // number of local modifications of 'h' since the last 'update'
+  int edits = 0;
+
+  WaterDepth(std::vector<int> shape, bool update = true) : shape(shape)
   {
     this->h.set_shape(shape);
-    this->update();
+    if (update)
+      this->update();
   }
 
   void set_shape(std::vector<int> new_shape)
@@ -78,4 +216,40 @@ public:
   }
 
   void update();
+
+  // raises (amount > 0) or lowers the sea floor around the cell (ic, jc)
+  // with a smooth falloff over 'radius' cells, the modified cells are
+  // returned in [i1, i2) x [j1, j2) (to be passed to
+  // 'GerstnerWave::update_region')
+  void apply_brush(float ic,
+                   float jc,
+                   float radius,
+                   float amount,
+                   int  &i1,
+                   int  &i2,
+                   int  &j1,
+                   int  &j2);
 };
+
+// excess wavenumber due to the finite water depth (zero in deep water)
+inline float wavenumber_excess(float h, float kinf, float k_clipping)
+{
+  float v = std::min(k_clipping, 1.f / std::sqrt(std::tanh(-kinf * h)));
+  return kinf * (v - 1.f);
+}
+
+// water depth and waves update as a single task graph
+void update_pipeline(WaterDepth &depth, GerstnerWave &wave);
+
+// copies the parameters only (neither the shape nor the fields)
+void copy_parameters(const WaterDepth &from, WaterDepth &to);
+void copy_parameters(const GerstnerWave &from, GerstnerWave &to);
+
+// hashes of the parameters defining the water depth and the waves (the
+// depth values themselves are not hashed, only the number of local
+// edits), 'hash' can be chained
+uint64_t parameters_hash(const WaterDepth &depth,
+                         uint64_t          hash = FNV1A_OFFSET);
+uint64_t parameters_hash(const GerstnerWave &wave,
+                         uint64_t            hash = FNV1A_OFFSET);
+uint64_t parameters_hash(const WaterDepth &depth, const GerstnerWave &wave);
@@ -0,0 +1,29 @@
+// Copyright (c) 2023 Otto Link. Distributed under the terms of the
+// GNU General Public License. The full license is in the file
+// LICENSE, distributed with this software.
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#define FNV1A_OFFSET 14695981039346656037ULL
+#define FNV1A_PRIME 1099511628211ULL
+
+// 64-bit FNV-1a hash, 'hash' can be chained to hash several buffers
+inline uint64_t fnv1a(const void *p_data,
+                      size_t      size,
+                      uint64_t    hash = FNV1A_OFFSET)
+{
+  const unsigned char *p = (const unsigned char *)p_data;
+
+  for (size_t k = 0; k < size; k++)
+  {
+    hash ^= (uint64_t)p[k];
+    hash *= FNV1A_PRIME;
+  }
+  return hash;
+}
+
+template <class T> inline uint64_t fnv1a(const T &value, uint64_t hash)
+{
+  return fnv1a(&value, sizeof(T), hash);
+}
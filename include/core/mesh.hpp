@@ -0,0 +1,45 @@
+// Copyright (c) 2023 Otto Link. Distributed under the terms of the
+// GNU General Public License. The full license is in the file
+// LICENSE, distributed with this software.
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "core/gerstner.hpp"
+
+// Indexed triangle mesh of the displaced wave surface. The topology only
+// depends on the shape, the level of detail and the skirts, and is built
+// once. Every frame, only the vertex positions are streamed into a
+// caller-owned interleaved vertex buffer: horizontal Gerstner
+// displacement (x, y) and elevation (z), i.e. the true Gerstner surface
+// (choppy crests) without any resampling pass. The deep water detail of
+// the wave ('GerstnerWave::p_spectral', if any) is added as in
+// 'GerstnerWave::generate', sampled at the displaced positions.
+class SurfaceMesh
+{
+public:
+  std::vector<int>      shape;
+  int                   lod_step;    // vertex spacing, in cells
+  float                 skirt_depth; // no skirts if zero
+  std::vector<uint32_t> indices;     // triangle list
+
+  SurfaceMesh(std::vector<int> shape, int lod_step = 1, float skirt_depth = 0.f);
+
+  size_t get_nvertices() const
+  {
+    return this->rows.size() * this->cols.size() + this->ring.size();
+  }
+
+  // positions written as 3 floats (x, y, z) at p_vertices + k * stride
+  // (in bytes) for vertex k, the other attributes are left untouched
+  void write_vertices(GerstnerWave &wave,
+                      float         t,
+                      float        *p_vertices,
+                      ptrdiff_t     stride);
+
+private:
+  std::vector<int>      rows; // grid indices of the vertices
+  std::vector<int>      cols;
+  std::vector<uint32_t> ring; // border vertices, for the skirts
+};
@@ -0,0 +1,87 @@
+// Copyright (c) 2023 Otto Link. Distributed under the terms of the
+// GNU General Public License. The full license is in the file
+// LICENSE, distributed with this software.
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "core/gerstner.hpp"
+#include "core/update_cache.hpp"
+
+// Progressive update of a water depth / waves pair: after a change of
+// parameters, the whole pipeline is first recomputed on a coarse grid
+// (instant feedback), then refined at full resolution in a background
+// thread once the input is idle. A refinement in progress is cancelled
+// by the next change. When the full resolution fields come from the
+// cache, the intermediate fields of 'GerstnerWave::update_region' are
+// rebuilt in the background as well, so that the next brush stroke is a
+// local update.
+class ProgressiveUpdate
+{
+public:
+  int   coarsening = 4;    // coarse grid is (shape / coarsening)
+  float idle_delay = 0.2f; // idle time before refinement (s)
+
+  // optional disk cache used by the refinement
+  UpdateCache *p_cache = nullptr;
+
+  ProgressiveUpdate(WaterDepth &depth, GerstnerWave &wave);
+
+  ~ProgressiveUpdate();
+
+  // parameters changed ('depth_changed' when the water depth parameters
+  // or the shape changed): coarse update and refinement scheduling
+  void request(bool depth_changed);
+
+  // to be called every frame, starts the refinement when the input is
+  // idle (or the rebuilding of the 'update_region' fields when they are
+  // missing) and collects its result. Returns true when the full
+  // resolution fields have just been updated
+  bool poll(bool interacting);
+
+  // blocks until the full resolution fields are up to date
+  void finish();
+
+  bool is_preview() const
+  {
+    return this->preview;
+  }
+
+  // fields to be displayed (coarse during the preview)
+  WaterDepth &get_depth()
+  {
+    return this->preview ? this->coarse_depth : this->depth;
+  }
+
+  GerstnerWave &get_wave()
+  {
+    return this->preview ? this->coarse_wave : this->wave;
+  }
+
+private:
+  WaterDepth   &depth;
+  GerstnerWave &wave;
+  WaterDepth    coarse_depth;
+  GerstnerWave  coarse_wave;
+  WaterDepth    fine_depth;
+  GerstnerWave  fine_wave;
+
+  std::thread       worker;
+  std::atomic<bool> cancel;
+  std::atomic<bool> done;
+  bool              running = false;
+  bool              pending = false;
+  bool              preview = false;
+  bool              depth_outdated = false;
+  bool              refining_depth = false;
+  bool              preparing = false; // 'update_region' fields only
+
+  std::chrono::steady_clock::time_point last_request;
+
+  void start_refinement();
+
+  void start_preparation();
+
+  bool collect();
+};
@@ -0,0 +1,74 @@
+// Copyright (c) 2023 Otto Link. Distributed under the terms of the
+// GNU General Public License. The full license is in the file
+// LICENSE, distributed with this software.
+#pragma once
+#include <memory>
+#include <vector>
+
+#include "core/array.hpp"
+
+#define RESAMPLING_CACHE_SIZE 4
+
+enum ResamplingMethod
+{
+  RESAMPLING_NEAREST,
+  RESAMPLING_BILINEAR
+};
+
+// regular grid, coordinates 'x' along the first index and 'y' along
+// the second index (end points included)
+struct Grid
+{
+  std::vector<int> shape;
+  float            xmin;
+  float            xmax;
+  float            ymin;
+  float            ymax;
+};
+
+// affine transform (x, y) -> (a00 * x + a01 * y + b0, a10 * x + a11 * y
+// + b1)
+struct Affine
+{
+  float a00;
+  float a01;
+  float a10;
+  float a11;
+  float b0;
+  float b1;
+};
+
+// Precomputed gather indices (and weights for bilinear interpolation)
+// to resample a field defined on a 'source' grid at the nodes of a
+// 'target' grid moved by an affine transform. Out-of-domain nodes are
+// clamped to the source grid borders.
+class ResamplingPlan
+{
+public:
+  std::vector<int>   shape; // target shape
+  int                method;
+  std::vector<int>   index;  // 1 (nearest) or 4 (bilinear) per node
+  std::vector<float> weight; // 4 per node (bilinear only)
+
+  ResamplingPlan(const Grid   &source,
+                 const Grid   &target,
+                 const Affine &transform,
+                 int           method = RESAMPLING_NEAREST);
+
+  Array apply(const Array &array) const;
+
+  void apply(const Array &array, Array &out) const;
+
+  // only on the target nodes covered by 'spans'
+  void apply(const Array                 &array,
+             Array                       &out,
+             const std::vector<CellSpan> &spans) const;
+};
+
+// Returns a plan from a small process-wide cache (least recently used
+// entries are dropped), the plan is built only on a cache miss.
+std::shared_ptr<const ResamplingPlan> get_resampling_plan(
+    const Grid   &source,
+    const Grid   &target,
+    const Affine &transform,
+    int           method = RESAMPLING_NEAREST);
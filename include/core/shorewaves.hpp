@@ -0,0 +1,66 @@
+// Copyright (c) 2023 Otto Link. Distributed under the terms of the
+// GNU General Public License. The full license is in the file
+// LICENSE, distributed with this software.
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "shorewaves.h"
+
+#include "core/gerstner.hpp"
+#include "core/update_cache.hpp"
+
+// Embeddable entry point of the core library: water depth (procedural
+// or imported) and shore waves, with the frames evaluated directly in
+// caller-owned memory.
+class ShoreWaves
+{
+public:
+  ShoreWaves(std::vector<int> shape);
+
+  ShoreWaves(const ShoreWaves &) = delete;
+
+  ShoreWaves &operator=(const ShoreWaves &) = delete;
+
+  std::vector<int> get_shape() const
+  {
+    return this->depth.shape;
+  }
+
+  sw_depth_params get_depth_params() const;
+
+  void set_depth_params(const sw_depth_params &params);
+
+  void set_depth_data(const float *p_h, ptrdiff_t stride_i, ptrdiff_t stride_j);
+
+  sw_wave_params get_wave_params() const;
+
+  void set_wave_params(const sw_wave_params &params);
+
+  // disk cache of the update products, disabled if 'dir' is empty
+  void set_cache_dir(std::string dir)
+  {
+    this->cache.dir = dir;
+  }
+
+  void update();
+
+  // true once 'update' has completed (not after a failed update), an
+  // update is run by 'generate' otherwise
+  bool is_updated() const
+  {
+    return this->updated;
+  }
+
+  void generate(float t, float *p_out, ptrdiff_t stride_i, ptrdiff_t stride_j);
+
+  WaterDepth   depth;
+  GerstnerWave wave;
+
+private:
+  bool        depth_imported = false;
+  bool        depth_outdated = true;
+  bool        updated = false;
+  UpdateCache cache = UpdateCache("");
+};
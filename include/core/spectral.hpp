@@ -0,0 +1,58 @@
+// Copyright (c) 2023 Otto Link. Distributed under the terms of the
+// GNU General Public License. The full license is in the file
+// LICENSE, distributed with this software.
+#pragma once
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include <complex>
+#include <vector>
+
+#include "core/array.hpp"
+#include "core/fft.hpp"
+
+// Deep water height field synthesized from a directional wave spectrum
+// (Phillips spectrum, Tessendorf 2001) with the FFT, on a periodic tile
+// repeated 'repeat' times across the domain [-pi, pi]^2. Each wave
+// component follows the deep water dispersion relation omega^2 =
+// gravity * k. The field is blended into the Gerstner waves elevation
+// by 'GerstnerWave::generate' (see 'GerstnerWave::p_spectral').
+class SpectralOcean
+{
+public:
+  std::vector<int> shape = {256, 256}; // tile resolution (powers of two)
+  int              repeat = 4;         // tiles across the domain
+  float            amplitude = 0.02f;  // RMS height
+  float            k_peak = 16.f;      // spectrum peak wavenumber
+  float            k_cutoff = 256.f;   // small waves damping
+  float            alpha = 15.f / 180.f * M_PI; // wind direction
+  float            directional_exponent = 2.f;
+  float            gravity = 4.f;
+  float            period = 0.f; // if > 0, seamless loop over 'period'
+  uint             seed = 1;
+
+  // height at the time of the last 'synthesize'
+  Array height = Array({0, 0});
+
+  SpectralOcean(bool update = true)
+  {
+    if (update)
+      this->update();
+  }
+
+  // random spectrum amplitudes and wave frequencies
+  void update();
+
+  void synthesize(float t);
+
+  // periodic bilinear interpolation at the domain coordinates (x, y)
+  float sample(float x, float y) const;
+
+  // private:
+  std::vector<std::complex<float>> h0;       // full spectrum, FFT order
+  std::vector<float>               omega;    // full spectrum
+  std::vector<std::complex<float>> spectrum; // half spectrum, work buffer
+
+  // inverse FFT plans of the tile shape, built by 'update'
+  FFTPlan plan_i = FFTPlan(1);
+  FFTPlan plan_j = FFTPlan(1);
+};
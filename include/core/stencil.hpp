@@ -0,0 +1,232 @@
+// Copyright (c) 2023 Otto Link. Distributed under the terms of the
+// GNU General Public License. The full license is in the file
+// LICENSE, distributed with this software.
+#pragma once
+#include <algorithm>
+
+#include "core/array.hpp"
+
+// Compile-time stencil framework. A "kernel" is a functor exposing a
+// static 'radius' (neighbourhood half-width) and a templated call
+// operator 'void operator()(const A &a, int k)', where 'a(di, dj)'
+// returns the neighbour at offset (di, dj) of the current cell and 'k'
+// is the flat index of the current cell (i * nj + j) used to store the
+// results. Interior cells are visited through a raw pointer accessor
+// (no boundary checks, vectorizable), border cells through an accessor
+// delegating the out-of-range lookups to a boundary policy.
+
+#define STENCIL_TILE_I 32
+#define STENCIL_TILE_J 256
+
+// --- boundary policies
+
+// linear extrapolation from the two nearest cells (with a centered
+// stencil, this is equivalent to a one-sided scheme at the borders)
+struct BoundaryExtrapolate
+{
+  static float at(const Array &array, int i, int j)
+  {
+    const int ni = array.shape[0];
+    const int nj = array.shape[1];
+
+    if (i < 0)
+      return (1.f - i) * at(array, 0, j) + i * at(array, 1, j);
+    if (i > ni - 1)
+    {
+      float c = (float)(i - ni + 1);
+      return (1.f + c) * at(array, ni - 1, j) - c * at(array, ni - 2, j);
+    }
+    if (j < 0)
+      return (1.f - j) * array(i, 0) + j * array(i, 1);
+    if (j > nj - 1)
+    {
+      float c = (float)(j - nj + 1);
+      return (1.f + c) * array(i, nj - 1) - c * array(i, nj - 2);
+    }
+    return array(i, j);
+  }
+};
+
+// nearest border value
+struct BoundaryClamp
+{
+  static float at(const Array &array, int i, int j)
+  {
+    i = std::min(std::max(i, 0), array.shape[0] - 1);
+    j = std::min(std::max(j, 0), array.shape[1] - 1);
+    return array(i, j);
+  }
+};
+
+// wrap-around (periodic domain)
+struct BoundaryPeriodic
+{
+  static float at(const Array &array, int i, int j)
+  {
+    const int ni = array.shape[0];
+    const int nj = array.shape[1];
+
+    i = ((i % ni) + ni) % ni;
+    j = ((j % nj) + nj) % nj;
+    return array(i, j);
+  }
+};
+
+// --- neighbourhood accessors
+
+struct InteriorAccessor
+{
+  const float *p;
+  int          stride;
+
+  inline float operator()(int di, int dj) const
+  {
+    return p[di * stride + dj];
+  }
+};
+
+template <class Boundary> struct BorderAccessor
+{
+  const Array *p_array;
+  int          i;
+  int          j;
+
+  inline float operator()(int di, int dj) const
+  {
+    return Boundary::at(*p_array, i + di, j + dj);
+  }
+};
+
+// --- stencils
+
+struct StencilGradientX
+{
+  static const int radius = 1;
+
+  template <class A> inline float operator()(const A &a) const
+  {
+    return 0.5f * (a(1, 0) - a(-1, 0));
+  }
+};
+
+struct StencilGradientY
+{
+  static const int radius = 1;
+
+  template <class A> inline float operator()(const A &a) const
+  {
+    return 0.5f * (a(0, 1) - a(0, -1));
+  }
+};
+
+struct StencilLaplacian
+{
+  static const int radius = 1;
+
+  template <class A> inline float operator()(const A &a) const
+  {
+    return a(1, 0) + a(-1, 0) + a(0, 1) + a(0, -1) - 4.f * a(0, 0);
+  }
+};
+
+// --- kernels storing stencil values
+
+template <class Stencil> struct KernelStore
+{
+  static const int radius = Stencil::radius;
+  Stencil          stencil;
+  float           *p_out;
+
+  template <class A> inline void operator()(const A &a, int k) const
+  {
+    p_out[k] = stencil(a);
+  }
+};
+
+// two stencils fused in a single sweep
+template <class Stencil1, class Stencil2> struct KernelStore2
+{
+  static const int radius = Stencil1::radius > Stencil2::radius
+                                ? Stencil1::radius
+                                : Stencil2::radius;
+  Stencil1         stencil1;
+  Stencil2         stencil2;
+  float           *p_out1;
+  float           *p_out2;
+
+  template <class A> inline void operator()(const A &a, int k) const
+  {
+    p_out1[k] = stencil1(a);
+    p_out2[k] = stencil2(a);
+  }
+};
+
+// --- sweep
+
+template <class Boundary, class Kernel>
+void stencil_sweep(const Array &array, const Kernel &kernel)
+{
+  const int    ni = array.shape[0];
+  const int    nj = array.shape[1];
+  const int    r = Kernel::radius;
+  const float *p = array.data();
+
+  // interior, tiled
+  const int nti = std::max(0, (ni - 2 * r + STENCIL_TILE_I - 1) /
+                                  STENCIL_TILE_I);
+  const int ntj = std::max(0, (nj - 2 * r + STENCIL_TILE_J - 1) /
+                                  STENCIL_TILE_J);
+
+#pragma omp parallel for collapse(2) schedule(static)
+  for (int ti = 0; ti < nti; ti++)
+    for (int tj = 0; tj < ntj; tj++)
+    {
+      const int i1 = r + ti * STENCIL_TILE_I;
+      const int i2 = std::min(ni - r, i1 + STENCIL_TILE_I);
+      const int j1 = r + tj * STENCIL_TILE_J;
+      const int j2 = std::min(nj - r, j1 + STENCIL_TILE_J);
+
+      for (int i = i1; i < i2; i++)
+#pragma omp simd
+        for (int j = j1; j < j2; j++)
+        {
+          const int        k = i * nj + j;
+          InteriorAccessor a = {p + k, nj};
+          kernel(a, k);
+        }
+    }
+
+  // borders
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < ni; i++)
+  {
+    if ((i < r) or (i >= ni - r))
+      for (int j = 0; j < nj; j++)
+      {
+        BorderAccessor<Boundary> a = {&array, i, j};
+        kernel(a, i * nj + j);
+      }
+    else
+    {
+      for (int j = 0; j < std::min(r, nj); j++)
+      {
+        BorderAccessor<Boundary> a = {&array, i, j};
+        kernel(a, i * nj + j);
+      }
+      for (int j = std::max(nj - r, r); j < nj; j++)
+      {
+        BorderAccessor<Boundary> a = {&array, i, j};
+        kernel(a, i * nj + j);
+      }
+    }
+  }
+}
+
+template <class Stencil, class Boundary = BoundaryExtrapolate>
+Array apply_stencil(const Array &array)
+{
+  Array                out = Array(array.shape);
+  KernelStore<Stencil> kernel = {Stencil(), out.data()};
+  stencil_sweep<Boundary>(array, kernel);
+  return out;
+}
@@ -0,0 +1,111 @@
+// Copyright (c) 2023 Otto Link. Distributed under the terms of the
+// GNU General Public License. The full license is in the file
+// LICENSE, distributed with this software.
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool: each worker has its own task queue
+// (last-in first-out for the owner, first-in first-out for the thieves)
+// and steals from the other workers when its queue is empty. Tasks can
+// be tagged with an owner (e.g. a task graph), so that a thread waiting
+// for its own tasks only helps with these.
+class ThreadPool
+{
+public:
+  ThreadPool(int nworkers);
+
+  ~ThreadPool();
+
+  // process-wide pool (one thread per core, the calling thread being
+  // expected to help while waiting)
+  static ThreadPool &get_instance();
+
+  // number of threads available, including the helping caller
+  int get_nthreads() const
+  {
+    return (int)this->workers.size() + 1;
+  }
+
+  // the tasks should not throw, an exception leaving a task on a worker
+  // terminates the program (the graph tasks catch their exceptions, see
+  // TaskGraph::run)
+  void submit(std::function<void()> task, const void *owner = nullptr);
+
+  // runs one pending task in the calling thread, only a task of 'owner'
+  // if not null, returns false if there was none
+  bool run_one(const void *owner = nullptr);
+
+  // OpenMP threads for each of the tasks pending or running in the pool
+  int thread_share() const;
+
+private:
+  struct Task
+  {
+    std::function<void()> fct;
+    const void           *owner;
+  };
+
+  struct Queue
+  {
+    std::mutex       mutex;
+    std::deque<Task> tasks;
+  };
+
+  std::vector<std::thread>            workers;
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::atomic<int>                    npending;
+  std::atomic<int>                    nrunning;
+  std::atomic<unsigned>               next_queue;
+  bool                                stop = false;
+  std::mutex                          sleep_mutex;
+  std::condition_variable             sleep_cv;
+
+  // most recent ('back') or oldest task of a queue, of a given owner if
+  // not null
+  static bool pop_task(std::deque<Task> &tasks,
+                       const void       *owner,
+                       bool              back,
+                       Task             &task);
+
+  bool pop(int id, const void *owner, Task &task);
+
+  void worker_loop(int id);
+};
+
+// Directed acyclic graph of tasks run on the thread pool, a task starts
+// once all its dependencies are done. The OpenMP parallel regions inside
+// the tasks share the cores: each task gets its share of the threads
+// depending on the number of tasks pending or running in the pool (all
+// graphs included), see also 'refresh_thread_share'.
+class TaskGraph
+{
+public:
+  int add_task(std::function<void()> fct, std::vector<int> dependencies = {});
+
+  // blocks until all the tasks are done, the calling thread only runs
+  // tasks of this graph while waiting (a graph run from the GUI thread
+  // is never held up by the tasks of a concurrent background graph) and
+  // sleeps when there is none to run. If a task throws, the tasks not
+  // started yet are skipped and the first exception is rethrown once
+  // the running tasks are done.
+  void run(ThreadPool &pool = ThreadPool::get_instance());
+
+private:
+  std::vector<std::function<void()>> fcts;
+  std::vector<std::vector<int>>      successors;
+  std::vector<int>                   ndependencies;
+};
+
+// Re-applies the thread share of the calling graph task for its next
+// OpenMP parallel regions, so that a long task gets more threads once
+// the concurrent tasks are done. To be called between the parallel
+// regions of a task, no effect outside of the graph tasks.
+void refresh_thread_share();
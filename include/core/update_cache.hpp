@@ -0,0 +1,65 @@
+// Copyright (c) 2023 Otto Link. Distributed under the terms of the
+// GNU General Public License. The full license is in the file
+// LICENSE, distributed with this software.
+#pragma once
+#include <cstdint>
+#include <string>
+
+#include "core/gerstner.hpp"
+
+// entries of another version are ignored: to be bumped whenever the
+// computation of the cached fields (water depth, shore distance, phase
+// lag) or the layout of the entries changes
+#define UPDATE_CACHE_FORMAT_VERSION 2
+
+#define UPDATE_CACHE_MAX_ENTRIES 32
+
+// $XDG_CACHE_HOME/shorewaves, or ~/.cache/shorewaves
+std::string default_cache_dir();
+
+// Content-addressed disk cache of the expensive update products (water
+// depth 'h', 'shore_dist' and 'phi_depth'), disabled if 'dir' is empty.
+// Each entry is a file named after its key, a 64-byte header followed by
+// the raw fields, which is memory-mapped when loaded. The least recently
+// used entries are removed beyond 'max_entries'.
+class UpdateCache
+{
+public:
+  std::string dir;
+  int         max_entries = UPDATE_CACHE_MAX_ENTRIES;
+
+  UpdateCache(std::string dir = default_cache_dir()) : dir(dir)
+  {
+  }
+
+  // key from the code version, the depth parameters (or the depth values
+  // if imported) and the wave parameters the cached fields depend on
+  uint64_t key(const WaterDepth   &depth,
+               const GerstnerWave &wave,
+               bool                depth_imported = false) const;
+
+  // restores the fields ('h' only if 'load_depth') and completes the
+  // wave update, returns false on a cache miss
+  bool load(uint64_t      key,
+            WaterDepth   &depth,
+            GerstnerWave &wave,
+            bool          load_depth = true) const;
+
+  bool store(uint64_t            key,
+             const WaterDepth   &depth,
+             const GerstnerWave &wave) const;
+
+private:
+  std::string get_fname(uint64_t key) const;
+
+  void evict() const;
+};
+
+// updates the water depth (if 'update_depth') and the waves, using the
+// cache when possible and storing the products otherwise (unless the
+// update has been cancelled), returns true on a cache hit
+bool cached_update(UpdateCache  &cache,
+                   WaterDepth   &depth,
+                   GerstnerWave &wave,
+                   bool          update_depth = true,
+                   bool          depth_imported = false);
@@ -0,0 +1,143 @@
+// Copyright (c) 2023 Otto Link. Distributed under the terms of the
+// GNU General Public License. The full license is in the file
+// LICENSE, distributed with this software.
+#pragma once
+#include <complex>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "core/array.hpp"
+#include "core/gerstner.hpp"
+#include "core/resampling.hpp"
+
+// Validation of the optimized kernels against straightforward reference
+// implementations (serial, double precision, no tiling, no span or
+// boundary shortcuts), to keep track of the numerical drift introduced
+// by the optimizations and the fast-math build flags.
+
+// error tolerances, a comparison passes if the RMS error is within
+// budget and if the max. error is within either the absolute or the ULP
+// budget
+struct ErrorBudget
+{
+  float   max_abs;
+  float   rms;
+  int64_t max_ulp;
+};
+
+struct ErrorReport
+{
+  float   max_abs;
+  float   rms;
+  int64_t max_ulp;
+};
+
+ErrorReport compare_arrays(const Array &reference, const Array &value);
+
+bool within_budget(const ErrorReport &error, const ErrorBudget &budget);
+
+// --- reference kernels
+
+Array reference_distance_transform(const Array &array, bool periodic = false);
+Array reference_gradient_angle(const Array &array, bool periodic = false);
+Array reference_gradient_x(const Array &array, bool periodic = false);
+Array reference_gradient_y(const Array &array, bool periodic = false);
+Array reference_laplacian(const Array &array, bool periodic = false);
+
+Array reference_fbm_perlin(std::vector<int>   shape,
+                           std::vector<float> kw,
+                           uint               seed,
+                           int                octaves,
+                           float              weight,
+                           float              persistence,
+                           float              lacunarity,
+                           std::vector<float> shift = {0.f, 0.f},
+                           bool               periodic = false);
+
+// inverse real 2D DFT of the half spectrum (see 'irfft2d'), separable
+// direct sums over the Hermitian extension
+Array reference_irfft2d(const std::vector<std::complex<float>> &spectrum,
+                        std::vector<int>                        shape);
+
+// bilinear resampling of 'array' (on the 'source' grid) at the nodes
+// of 'target' moved by 'transform', clamped to the source grid (see
+// 'ResamplingPlan')
+Array reference_resample_bilinear(const Array  &array,
+                                  const Grid   &source,
+                                  const Grid   &target,
+                                  const Affine &transform);
+
+// decoded BC4 plane (width x height, see 'compress_bc4'), with 'stride'
+// bytes between consecutive blocks (16 for a channel of BC5 data, the
+// second one being at offset 8)
+std::vector<float> reference_decode_bc4(const uint8_t *p_data,
+                                        int            width,
+                                        int            height,
+                                        int            stride = 8);
+
+// number of values in 'nbins' bins evenly spanning [min, max] (see
+// 'Array::histogram')
+std::vector<int> reference_histogram(const Array &array, int nbins);
+
+// depth-dependent fields of the wave, from its water depth and
+// parameters only. The phase lag is integrated along the ray through
+// each cell, independently of the rotated grid or the lines of the
+// model
+Array reference_shore_distance(const GerstnerWave &wave);
+Array reference_phase_lag(const GerstnerWave &wave);
+
+// full model evaluated at every cell, with the reference shore distance
+// and the phase lag of the wave (which needs to be updated)
+Array reference_generate(const GerstnerWave &wave, float t);
+
+// --- validation runs
+
+// default budgets, per kernel name
+std::map<std::string, ErrorBudget> default_error_budgets();
+
+struct ValidationConfig
+{
+  std::vector<std::vector<int>>      shapes = {{64, 64}, {96, 128}};
+  // additional inverse FFT shapes (non-square, odd powers of two)
+  std::vector<std::vector<int>>      fft_shapes = {{128, 32}, {32, 8}};
+  // two-level model against the single level model (large enough for
+  // the coarse level and the tiles)
+  std::vector<std::vector<int>>      adaptive_shapes = {{512, 512}};
+  // local updates after random brush strokes against a full update
+  std::vector<std::vector<int>>      region_shapes = {{256, 256}, {384, 256}};
+  int                                region_brushes = 40;
+  std::vector<uint>                  seeds = {1, 2};
+  std::vector<float>                 times = {0.f, 1.3f};
+  std::map<std::string, ErrorBudget> budgets = default_error_budgets();
+
+  // optional allocation failure injection: the allocations of at least
+  // 'size' bytes fail from then on (no limit if zero), e.g. through a
+  // replaced global operator new. Used to check the errors returned by
+  // the C interface, the check is skipped if not set
+  std::function<void(size_t size)> set_allocation_limit;
+
+  // golden outputs directory (not used if empty), the optimized outputs
+  // are stored if 'update_golden' is set and compared to the stored
+  // ones (with the same budgets) otherwise
+  std::string golden_dir = "";
+  bool        update_golden = false;
+};
+
+struct ValidationResult
+{
+  std::string kernel;
+  std::string label;   // shape, seed and options of the case
+  std::string against; // "reference" or "golden"
+  ErrorReport error;
+  bool        passed;
+};
+
+// runs every kernel over the configured shapes, seeds, times and with
+// and without periodic domain, each result is also logged
+std::vector<ValidationResult> validate_kernels(
+    const ValidationConfig &config = ValidationConfig());
+
+bool all_passed(const std::vector<ValidationResult> &results);
@@ -2,12 +2,14 @@
 // GNU General Public License. The full license is in the file
 // LICENSE, distributed with this software.
 #pragma once
+#include <algorithm>
 #include <iostream>
 
 #include <GLFW/glfw3.h>
 #include <imgui.h>
 
 #include "core/gerstner.hpp"
+#include "core/spectral.hpp"
 
 class GuiWaterDepth
 {
@@ -20,28 +22,44 @@ public:
     this->width = this->wd.shape[0];
     this->height = this->wd.shape[1];
     this->seed = this->wd.seed;
+  }
+
+  // largest domain size, the domain is shrunk if needed (sizes above
+  // 2048 are only tractable with the adaptive model)
+  void set_max_size(int n)
+  {
+    this->max_size = n;
 
-    this->wd.update();
+    if (this->width > n or this->height > n)
+    {
+      this->width = std::min(this->width, n);
+      this->height = std::min(this->height, n);
+      this->wd.set_shape({this->width, this->height});
+      this->update();
+    }
   }
 
   void render()
   {
     ImGui::Text("Domain size");
 
-    if (ImGui::SliderInt("Width", &this->width, 32, 2048))
+    if (ImGui::SliderInt("Width", &this->width, 32, this->max_size))
     {
       this->width -= this->width % 32;
       this->wd.set_shape({this->width, this->height});
       this->update();
     }
 
-    if (ImGui::SliderInt("Height", &this->height, 32, 2048))
+    if (ImGui::SliderInt("Height", &this->height, 32, this->max_size))
     {
       this->height -= this->height % 32;
       this->wd.set_shape({this->width, this->height});
       this->update();
     }
 
+    if (ImGui::Checkbox("Periodic (tileable) domain", &this->wd.periodic))
+      this->update();
+
     ImGui::Text("fBm noise");
 
     if (ImGui::SliderFloat("Wavenumber x", &this->wd.kw[0], 0.1f, 64.f))
@@ -74,9 +92,9 @@ public:
       this->update();
   }
 
+  // the actual computation is left to the caller (progressive update)
   void update()
   {
-    wd.update();
     this->updated = true;
   }
 
@@ -84,6 +102,7 @@ private:
   int width;
   int height;
   int seed;
+  int max_size = 2048;
 };
 
 class GuiGerstnerWave
@@ -94,7 +113,6 @@ public:
 
   GuiGerstnerWave(GerstnerWave &w) : w(w)
   {
-    this->w.update();
   }
 
   void render()
@@ -130,9 +148,66 @@ public:
       this->update();
   }
 
+  // the actual computation is left to the caller (progressive update)
+  void update()
+  {
+    this->updated = true;
+  }
+};
+
+class GuiSpectralOcean
+{
+public:
+  SpectralOcean &so;
+  bool           updated = false;
+
+  GuiSpectralOcean(SpectralOcean &so) : so(so)
+  {
+    this->log2_resolution = 0;
+    while ((1 << this->log2_resolution) < this->so.shape[0])
+      this->log2_resolution++;
+    this->seed = this->so.seed;
+  }
+
+  void render()
+  {
+    if (ImGui::SliderFloat("Amplitude", &this->so.amplitude, 0.f, 0.1f))
+      this->update();
+
+    if (ImGui::SliderFloat("Peak wavenumber", &this->so.k_peak, 1.f, 64.f))
+      this->update();
+
+    if (ImGui::SliderFloat("Directional exponent",
+                           &this->so.directional_exponent,
+                           0.f,
+                           8.f))
+      this->update();
+
+    if (ImGui::SliderInt("Tiles", &this->so.repeat, 1, 16))
+      this->update();
+
+    if (ImGui::SliderInt("Resolution (log2)", &this->log2_resolution, 5, 10))
+    {
+      int n = 1 << this->log2_resolution;
+      this->so.shape = {n, n};
+      this->update();
+    }
+
+    if (ImGui::DragInt("Seed##spectral", &this->seed))
+    {
+      this->so.seed = (uint)this->seed;
+      this->update();
+    }
+  }
+
+  // the actual computation is left to the caller (synchronized with the
+  // wave parameters)
   void update()
   {
-    w.update();
     this->updated = true;
   }
+
+private:
+  int log2_resolution;
+  int seed;
 };
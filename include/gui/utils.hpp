@@ -9,6 +9,8 @@
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
 
+#include "core/array.hpp"
+
 static void glfw_error_callback(int error, const char *description)
 {
   std::cout << "GLFW Error " << error << " " << description << std::endl;
@@ -63,3 +65,47 @@ GLFWwindow *init_gui(int width, int height, std::string window_title)
 
   return window;
 }
+
+void to_texture(const Array &array,
+                GLuint      &image_texture,
+                int          colormap,
+                const Array *p_mask = nullptr)
+{
+  glBindTexture(GL_TEXTURE_2D, image_texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+  // Upload pixels into texture
+#if defined(GL_UNPACK_ROW_LENGTH) && !defined(__EMSCRIPTEN__)
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+#endif
+
+  switch (colormap)
+  {
+  case 0:
+    glTexImage2D(GL_TEXTURE_2D,
+                 0,
+                 GL_RGBA,
+                 array.shape[0],
+                 array.shape[1],
+                 0,
+                 GL_LUMINANCE,
+                 GL_UNSIGNED_BYTE,
+                 array.to_img_8bit_grayscale().data());
+    break;
+
+  case 1:
+    glTexImage2D(GL_TEXTURE_2D,
+                 0,
+                 GL_RGBA,
+                 array.shape[0],
+                 array.shape[1],
+                 0,
+                 GL_RGB,
+                 GL_UNSIGNED_BYTE,
+                 array.to_img_8bit_rgb(p_mask).data());
+    break;
+  }
+}
@@ -0,0 +1,121 @@
+/* Copyright (c) 2023 Otto Link. Distributed under the terms of the
+ * GNU General Public License. The full license is in the file
+ * LICENSE, distributed with this software.
+ *
+ * Plain C interface of the shorewaves core library. */
+#ifndef SHOREWAVES_H
+#define SHOREWAVES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SW_OK 0
+#define SW_ERROR_INVALID_ARGUMENT 1
+#define SW_ERROR_OUT_OF_MEMORY 2
+#define SW_ERROR_INTERNAL 3 /* unexpected C++ exception */
+
+typedef struct sw_model sw_model;
+typedef struct sw_mesh  sw_mesh;
+
+/* procedural water depth (fBm noise + linear sea floor) */
+typedef struct sw_depth_params
+{
+  float        kw[2];
+  unsigned int seed;
+  int          octaves;
+  float        weight;
+  float        persistence;
+  float        lacunarity;
+  float        slope;
+  float        offset;
+  float        scaling;
+  int          periodic; /* tileable domain, slope ignored */
+} sw_depth_params;
+
+typedef struct sw_wave_params
+{
+  float kinf;
+  float alpha;
+  float steepness;
+  float phi0;
+  float phase_speed;
+  float kludge;
+  float k_clipping_ratio;
+  float shore_dist_ratio;
+  float shore_r_ratio;
+  int   periodic; /* tileable domain, wave vector snapped to the tile */
+} sw_wave_params;
+
+/* returns NULL if the shape is invalid or on allocation failure, the
+ * model is only computed by the first sw_update (or sw_generate) */
+sw_model *sw_create(int ni, int nj);
+
+void sw_destroy(sw_model *p_model);
+
+void sw_get_depth_params(const sw_model *p_model, sw_depth_params *p_params);
+
+/* switches back to the procedural water depth */
+int sw_set_depth_params(sw_model *p_model, const sw_depth_params *p_params);
+
+/* imports the water depth (negative in water, positive on land),
+ * strides in bytes */
+int sw_set_depth_data(sw_model    *p_model,
+                      const float *p_h,
+                      ptrdiff_t    stride_i,
+                      ptrdiff_t    stride_j);
+
+void sw_get_wave_params(const sw_model *p_model, sw_wave_params *p_params);
+
+int sw_set_wave_params(sw_model *p_model, const sw_wave_params *p_params);
+
+/* enables the disk cache of the depth-dependent quantities (disabled by
+ * default): entries are stored in 'dir', or in the default user cache
+ * directory ($XDG_CACHE_HOME/shorewaves or ~/.cache/shorewaves) if 'dir'
+ * is empty, NULL disables the cache */
+int sw_set_cache_dir(sw_model *p_model, const char *dir);
+
+/* recomputes the depth-dependent quantities, to be called after a
+ * change of parameters or of depth data. On error the model is left
+ * partially updated until the next successful call */
+int sw_update(sw_model *p_model);
+
+/* evaluates the elevation at time t in a caller-owned buffer, element
+ * (i, j) is written at (char *)p_out + i * stride_i + j * stride_j */
+int sw_generate(sw_model *p_model,
+                float     t,
+                float    *p_out,
+                ptrdiff_t stride_i,
+                ptrdiff_t stride_j);
+
+/* indexed triangle mesh of the displaced surface (topology built once,
+ * lod_step is the vertex spacing in cells, no skirts if skirt_depth is
+ * zero), NULL on allocation failure */
+sw_mesh *sw_mesh_create(const sw_model *p_model,
+                        int             lod_step,
+                        float           skirt_depth);
+
+void sw_mesh_destroy(sw_mesh *p_mesh);
+
+size_t sw_mesh_get_vertex_count(const sw_mesh *p_mesh);
+
+size_t sw_mesh_get_index_count(const sw_mesh *p_mesh);
+
+const uint32_t *sw_mesh_get_indices(const sw_mesh *p_mesh);
+
+/* writes the vertex positions (x, y, z) of the displaced surface at time
+ * t, vertex k at (char *)p_vertices + k * stride */
+int sw_mesh_write_vertices(sw_mesh  *p_mesh,
+                           sw_model *p_model,
+                           float     t,
+                           float    *p_vertices,
+                           ptrdiff_t stride);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,771 @@
+// Copyright (c) 2023 Otto Link. Distributed under the terms of the
+// GNU General Public License. The full license is in the file
+// LICENSE, distributed with this software.
+#include <limits>
+
+#include "core/adaptive.hpp"
+#include "core/array.hpp"
+#include "core/spectral.hpp"
+
+static inline int wrap(int i, int n)
+{
+  return (i % n + n) % n;
+}
+
+// interpolation nodes and weight along one axis of the coarse grid,
+// clamped to the borders (or periodic)
+static inline void coarse_nodes(float  uc,
+                                int    n,
+                                bool   periodic,
+                                int   &p,
+                                int   &p1,
+                                float &tu)
+{
+  if (periodic)
+  {
+    float uf = std::floor(uc);
+    tu = uc - uf;
+    p = wrap((int)uf, n);
+    p1 = p + 1 < n ? p + 1 : 0;
+  }
+  else
+  {
+    uc = std::max(0.f, std::min((float)(n - 1), uc));
+    p = std::min(n - 2, (int)uc);
+    tu = uc - (float)p;
+    p1 = p + 1;
+  }
+}
+
+// bilinear interpolation on the coarse grid
+static inline float interp_coarse(const Array &array,
+                                  float        uc,
+                                  float        vc,
+                                  bool         periodic)
+{
+  int   p, q, p1, q1;
+  float tu, tv;
+
+  coarse_nodes(uc, array.shape[0], periodic, p, p1, tu);
+  coarse_nodes(vc, array.shape[1], periodic, q, q1, tv);
+
+  return (1.f - tu) * ((1.f - tv) * array(p, q) + tv * array(p, q1)) +
+         tu * ((1.f - tv) * array(p1, q) + tv * array(p1, q1));
+}
+
+// direction of the waves in full resolution cells per unit length, and
+// scaling of the phase lag integral (see 'GerstnerWave::update_phase_lag')
+static void wave_direction(const AdaptiveWave &aw,
+                           float              &di,
+                           float              &dj,
+                           float              &factor)
+{
+  const int d = aw.coarse.periodic ? 0 : 1;
+  float     kx, ky;
+  aw.coarse.wave_vector(kx, ky);
+
+  const float kn = std::max(1e-6f, std::hypot(kx, ky));
+  di = kx / kn * (float)(aw.shape[0] - d) / (2.f * M_PI);
+  dj = ky / kn * (float)(aw.shape[1] - d) / (2.f * M_PI);
+  factor = aw.coarse.periodic ? 1.f : std::cos(aw.coarse.alpha);
+}
+
+void AdaptiveWave::update()
+{
+  this->shape = this->p_h->shape;
+  this->dz.set_shape(this->shape);
+
+  this->update_coarse_depth();
+  this->coarse.update();
+  this->update_tiles();
+}
+
+void AdaptiveWave::to_coarse(float u, float v, float &uc, float &vc) const
+{
+  const int d = this->coarse.periodic ? 0 : 1;
+
+  uc = u * (float)(this->coarse_shape[0] - d) / (float)(this->shape[0] - d);
+  vc = v * (float)(this->coarse_shape[1] - d) / (float)(this->shape[1] - d);
+}
+
+void AdaptiveWave::update_coarse_depth()
+{
+  const int f = std::max(1, this->coarsening);
+
+  // in periodic mode the last node is the first node of the next tile
+  if (this->coarse.periodic)
+    this->coarse_shape = {std::max(2, this->shape[0] / f),
+                          std::max(2, this->shape[1] / f)};
+  else
+    this->coarse_shape = {(this->shape[0] + f - 2) / f + 1,
+                          (this->shape[1] + f - 2) / f + 1};
+
+  this->coarse_h.set_shape(this->coarse_shape);
+
+  // nearest full resolution node
+  const Array &h = *this->p_h;
+  const int    d = this->coarse.periodic ? 0 : 1;
+  const float  si = (float)(this->shape[0] - d) /
+                   (float)(this->coarse_shape[0] - d);
+  const float sj = (float)(this->shape[1] - d) /
+                   (float)(this->coarse_shape[1] - d);
+
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < this->coarse_shape[0]; i++)
+  {
+    int    p = std::min(this->shape[0] - 1, (int)std::round(i * si));
+    float *p_row = &this->coarse_h(i, 0);
+
+    for (int j = 0; j < this->coarse_shape[1]; j++)
+      p_row[j] = h(p, std::min(this->shape[1] - 1, (int)std::round(j * sj)));
+  }
+}
+
+void AdaptiveWave::update_tiles()
+{
+  const Array &h = *this->p_h;
+  const int    ts = std::max(2, this->tile_size);
+  const int    nci = this->coarse_shape[0];
+  const int    ncj = this->coarse_shape[1];
+
+  this->tile_size = ts;
+  this->nti = (this->shape[0] + ts - 1) / ts;
+  this->ntj = (this->shape[1] + ts - 1) / ts;
+  this->tile_index.assign(this->nti * this->ntj, TILE_COARSE);
+
+  // --- classification: land only, shore band or open water
+
+#pragma omp parallel for schedule(dynamic, 4)
+  for (int a = 0; a < this->nti; a++)
+    for (int b = 0; b < this->ntj; b++)
+    {
+      const int i0 = a * ts;
+      const int i1 = std::min(this->shape[0], i0 + ts);
+      const int j0 = b * ts;
+      const int j1 = std::min(this->shape[1], j0 + ts);
+
+      bool land = false;
+      bool water = false;
+
+      for (int i = i0; i < i1 and !(land and water); i++)
+        for (int j = j0; j < j1; j++)
+          if (h(i, j) >= 0.f)
+            land = true;
+          else
+            water = true;
+
+      // coarse shore distance on the coarse cells covering the tile
+      float uc1, vc1, uc2, vc2;
+      this->to_coarse((float)i0, (float)j0, uc1, vc1);
+      this->to_coarse((float)(i1 - 1), (float)(j1 - 1), uc2, vc2);
+
+      float sd_min = 1.f;
+      for (int p = (int)std::floor(uc1) - 1; p <= (int)std::ceil(uc2) + 1; p++)
+        for (int q = (int)std::floor(vc1) - 1; q <= (int)std::ceil(vc2) + 1;
+             q++)
+        {
+          if (!this->coarse.periodic and
+              (p < 0 or p >= nci or q < 0 or q >= ncj))
+            continue;
+          sd_min = std::min(
+              sd_min,
+              this->coarse.shore_dist(wrap(p, nci), wrap(q, ncj)));
+        }
+
+      int &index = this->tile_index[a * this->ntj + b];
+
+      if (!water)
+        index = TILE_LAND;
+      else if (land or sd_min < this->band_threshold)
+        index = 0; // refined, numbered below
+    }
+
+  // --- refined tiles
+
+  this->tiles.clear();
+
+  for (int a = 0; a < this->nti; a++)
+    for (int b = 0; b < this->ntj; b++)
+    {
+      int &index = this->tile_index[a * this->ntj + b];
+      if (index != 0)
+        continue;
+
+      index = (int)this->tiles.size();
+      this->tiles.push_back(ShoreTile());
+      this->tiles.back().i0 = a * ts;
+      this->tiles.back().j0 = b * ts;
+    }
+
+#pragma omp parallel for schedule(dynamic, 1)
+  for (size_t k = 0; k < this->tiles.size(); k++)
+    this->update_tile_fields(this->tiles[k]);
+
+  // --- full resolution phase lag, level by level from upstream (the
+  // --- level of a tile is above the ones of its upstream neighbours)
+
+  float kx, ky;
+  this->coarse.wave_vector(kx, ky);
+
+  std::vector<std::vector<int>> levels(this->nti + this->ntj);
+  this->tile_level.resize(this->tiles.size());
+
+  for (size_t k = 0; k < this->tiles.size(); k++)
+  {
+    int a = this->tiles[k].i0 / ts;
+    int b = this->tiles[k].j0 / ts;
+
+    this->tile_level[k] = (kx >= 0.f ? a : this->nti - 1 - a) +
+                          (ky >= 0.f ? b : this->ntj - 1 - b);
+    levels[this->tile_level[k]].push_back((int)k);
+  }
+
+  for (auto &level : levels)
+  {
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t k = 0; k < level.size(); k++)
+      this->integrate_tile_phase_lag(this->tiles[level[k]]);
+  }
+}
+
+void AdaptiveWave::update_tile_fields(ShoreTile &tile)
+{
+  const Array &h = *this->p_h;
+  const bool   periodic = this->coarse.periodic;
+  const int    ni = this->shape[0];
+  const int    nj = this->shape[1];
+  const int    ts = this->tile_size;
+  const int    hw = std::max(0, this->halo);
+
+  // one node overlap with the next tiles
+  const int n0 = periodic ? std::min(ts, ni - tile.i0) + 1
+                          : std::min(ts + 1, ni - tile.i0);
+  const int n1 = periodic ? std::min(ts, nj - tile.j0) + 1
+                          : std::min(ts + 1, nj - tile.j0);
+
+  tile.shore_dist.set_shape({n0, n1});
+  tile.phi_depth.set_shape({n0, n1});
+  tile.x_disp.set_shape({n0, n1});
+  tile.y_disp.set_shape({n0, n1});
+  tile.dz_disp.set_shape({n0, n1});
+
+  // --- shore distance: exact up to 'halo' cells (the nearest land cell
+  // --- is then within the window), coarse level otherwise
+
+  const int wi1 = periodic ? tile.i0 - hw : std::max(0, tile.i0 - hw);
+  const int wi2 = periodic ? tile.i0 + n0 + hw
+                           : std::min(ni, tile.i0 + n0 + hw);
+  const int wj1 = periodic ? tile.j0 - hw : std::max(0, tile.j0 - hw);
+  const int wj2 = periodic ? tile.j0 + n1 + hw
+                           : std::min(nj, tile.j0 + n1 + hw);
+
+  Array window = Array({wi2 - wi1, wj2 - wj1});
+
+  for (int i = wi1; i < wi2; i++)
+  {
+    float *p_row = &window(i - wi1, 0);
+    for (int j = wj1; j < wj2; j++)
+      p_row[j - wj1] = h(wrap(i, ni), wrap(j, nj));
+  }
+
+  Array dt = distance_transform(window);
+
+  const float c_decay = 0.5f / std::pow((float)ni / this->coarse.kinf *
+                                            this->coarse.shore_dist_ratio,
+                                        2.f);
+  const int   d = periodic ? 0 : 1;
+  const float scale = (float)(ni - d) / (float)(this->coarse_shape[0] - d);
+
+  for (int k = 0; k < n0; k++)
+    for (int l = 0; l < n1; l++)
+    {
+      float uc, vc;
+      this->to_coarse((float)(tile.i0 + k), (float)(tile.j0 + l), uc, vc);
+
+      float d2 = dt(tile.i0 + k - wi1, tile.j0 + l - wj1);
+
+      if (d2 > (float)(hw * hw))
+      {
+        float dc = scale * std::sqrt(interp_coarse(this->coarse.dt,
+                                                   uc,
+                                                   vc,
+                                                   periodic));
+        d2 = std::pow(std::max((float)hw, dc), 2.f);
+      }
+
+      tile.shore_dist(k, l) = 1.f - std::exp(-d2 * c_decay);
+    }
+}
+
+float AdaptiveWave::phase_lag(float u, float v, int level, int depth) const
+{
+  const bool periodic = this->coarse.periodic;
+  const int  ni = this->shape[0];
+  const int  nj = this->shape[1];
+  const int  ts = this->tile_size;
+
+  float uc, vc;
+  this->to_coarse(u, v, uc, vc);
+
+  if (periodic)
+  {
+    u -= std::floor(u / (float)ni) * (float)ni;
+    v -= std::floor(v / (float)nj) * (float)nj;
+  }
+  else if (u < 0.f || v < 0.f || u > (float)(ni - 1) || v > (float)(nj - 1))
+    return interp_coarse(this->coarse.phi_depth, uc, vc, periodic);
+
+  const int a = std::min(this->nti - 1, (int)u / ts);
+  const int b = std::min(this->ntj - 1, (int)v / ts);
+  const int index = this->tile_index[a * this->ntj + b];
+
+  if (index >= 0 and this->tile_level[index] < level)
+  {
+    const ShoreTile &tile = this->tiles[index];
+    const Array     &phi = tile.phi_depth;
+    const float      uk = std::min((float)(phi.shape[0] - 1), u - tile.i0);
+    const float      vl = std::min((float)(phi.shape[1] - 1), v - tile.j0);
+    const int        k = std::max(0, std::min(phi.shape[0] - 2, (int)uk));
+    const int        l = std::max(0, std::min(phi.shape[1] - 2, (int)vl));
+    const int        k1 = std::min(phi.shape[0] - 1, k + 1);
+    const int        l1 = std::min(phi.shape[1] - 1, l + 1);
+    const float      tu = uk - (float)k;
+    const float      tv = vl - (float)l;
+
+    return (1.f - tu) * ((1.f - tv) * phi(k, l) + tv * phi(k, l1)) +
+           tu * ((1.f - tv) * phi(k1, l) + tv * phi(k1, l1));
+  }
+
+  // the coarse phase lag is shifted by up to a few coarse cells, which
+  // is noticeable where the excess is large: on land, the phase lag is
+  // traced back to the upstream edge of the tile
+  if (index == TILE_LAND and depth < this->nti + this->ntj)
+  {
+    float di, dj, factor;
+    wave_direction(*this, di, dj, factor);
+
+    // path length to the upstream edge (just past it, in the next tile)
+    const float eps = 1e-3f;
+    const float i0 = (float)(a * ts);
+    const float j0 = (float)(b * ts);
+    float       s = std::numeric_limits<float>::max();
+
+    if (di > 0.f)
+      s = std::min(s, (u - i0 + eps) / di);
+    else if (di < 0.f)
+      s = std::min(s, (i0 + (float)ts - u) / -di);
+    if (dj > 0.f)
+      s = std::min(s, (v - j0 + eps) / dj);
+    else if (dj < 0.f)
+      s = std::min(s, (j0 + (float)ts - v) / -dj);
+
+    const float fk = factor * wavenumber_excess(0.f,
+                                                this->coarse.kinf,
+                                                this->coarse.k_clipping_ratio) -
+                     this->coarse.phase_drift(uc, vc);
+
+    return this->phase_lag(u - s * di, v - s * dj, level, depth + 1) + s * fk;
+  }
+
+  return interp_coarse(this->coarse.phi_depth, uc, vc, periodic);
+}
+
+void AdaptiveWave::integrate_tile_phase_lag(ShoreTile &tile)
+{
+  const Array &h = *this->p_h;
+  const int    ni = this->shape[0];
+  const int    nj = this->shape[1];
+  const int    ts = this->tile_size;
+  const int    level =
+      this->tile_level[this->tile_index[(tile.i0 / ts) * this->ntj +
+                                        tile.j0 / ts]];
+
+  float di, dj, factor;
+  wave_direction(*this, di, dj, factor);
+
+  // line coordinates: one node along 'a' per step, 'b' across
+  const bool  march_i = std::abs(di) >= std::abs(dj);
+  const bool  reverse = march_i ? di < 0.f : dj < 0.f;
+  const float ds = 1.f / std::max(std::abs(di), std::abs(dj));
+  const float shear = march_i ? dj / std::abs(di) : di / std::abs(dj);
+  const int   n0 = tile.phi_depth.shape[0];
+  const int   n1 = tile.phi_depth.shape[1];
+  const int   na = march_i ? n0 : n1;
+  const int   nb = march_i ? n1 : n0;
+
+  // node of the tile from the line coordinates
+  auto node = [&](float a, float b, float &k, float &l)
+  {
+    float p = reverse ? (float)(na - 1) - a : a;
+    k = march_i ? p : b;
+    l = march_i ? b : p;
+  };
+
+  // integrand, wavenumber excess less the drift in periodic mode
+  std::vector<float> fk(na * nb);
+
+  for (int a = 0; a < na; a++)
+    for (int b = 0; b < nb; b++)
+    {
+      float k, l, uc, vc;
+      node((float)a, (float)b, k, l);
+
+      const int i = tile.i0 + (int)k;
+      const int j = tile.j0 + (int)l;
+      this->to_coarse((float)i, (float)j, uc, vc);
+
+      fk[a * nb + b] =
+          factor * wavenumber_excess(h(i < ni ? i : i - ni,
+                                       j < nj ? j : j - nj),
+                                     this->coarse.kinf,
+                                     this->coarse.k_clipping_ratio) -
+          this->coarse.phase_drift(uc, vc);
+    }
+
+  // --- integration along the lines crossing the tile, seeded where they
+  // --- enter the tile (the values outside the tile are only looked up
+  // --- next to the tile, for the gathering)
+
+  const float span = shear * (float)(na - 1);
+  const int   line0 = (int)std::floor(std::min(0.f, -span));
+  const int   nlines = (int)std::ceil((float)(nb - 1) + std::max(0.f, -span)) -
+                     line0 + 2;
+  const float margin = std::abs(shear) + 1.f;
+
+  std::vector<float> lines(nlines * na);
+
+  // the lines leaving the domain (non periodic mode) go on with the
+  // border nodes
+  const int   bj0 = march_i ? tile.j0 : tile.i0;
+  const bool  border = !this->coarse.periodic;
+  const float b_min = border and bj0 == 0 ? -margin : 0.f;
+  const float b_max = border and bj0 + nb == (march_i ? nj : ni)
+                          ? (float)(nb - 1) + margin
+                          : (float)(nb - 1);
+
+  auto lookup = [&](float a, float b)
+  {
+    float k, l;
+    node(a, b, k, l);
+    return this->phase_lag((float)tile.i0 + k, (float)tile.j0 + l, level);
+  };
+
+  for (int line = 0; line < nlines; line++)
+  {
+    float *p_line = &lines[line * na];
+    bool   inside = false;
+
+    for (int a = 0; a < na; a++)
+    {
+      const float b = (float)(line0 + line) + shear * (float)a;
+
+      if (b < b_min or b > b_max)
+      {
+        p_line[a] = b > -margin and b < (float)(nb - 1) + margin
+                        ? lookup((float)a, b)
+                        : 0.f;
+        inside = false;
+        continue;
+      }
+
+      // previous node of the line
+      const float seed = inside ? p_line[a - 1]
+                                : lookup((float)(a - 1), b - shear);
+      const float bc = std::max(0.f, std::min((float)(nb - 1), b));
+      const int   b1 = std::min(std::max(0, nb - 2), (int)bc);
+      const int   b2 = std::min(nb - 1, b1 + 1);
+      const float w = bc - (float)b1;
+
+      p_line[a] = seed + ds * ((1.f - w) * fk[a * nb + b1] +
+                               w * fk[a * nb + b2]);
+      inside = true;
+    }
+  }
+
+  // --- gather at the nodes, between the two nearest lines
+
+  for (int a = 0; a < na; a++)
+    for (int b = 0; b < nb; b++)
+    {
+      const float x = (float)b - shear * (float)a - (float)line0;
+      const int   l1 = std::max(0, std::min(nlines - 2, (int)std::floor(x)));
+      const float w = x - (float)l1;
+
+      float k, l;
+      node((float)a, (float)b, k, l);
+      tile.phi_depth((int)k, (int)l) = (1.f - w) * lines[l1 * na + a] +
+                                       w * lines[(l1 + 1) * na + a];
+    }
+}
+
+void AdaptiveWave::displace_tile(ShoreTile &tile, float t)
+{
+  const Array &h = *this->p_h;
+  const int    ni = this->shape[0];
+  const int    nj = this->shape[1];
+  const int    d = this->coarse.periodic ? 0 : 1;
+
+  const GerstnerWave &w = this->coarse;
+  const float         ca = std::cos(w.alpha);
+  const float         sa = std::sin(w.alpha);
+  float               kx, ky;
+  w.wave_vector(kx, ky);
+  const float phase = -w.omega * t + w.phi0;
+
+  const float dx = 2.f * M_PI / (float)(ni - d);
+  const float dy = 2.f * M_PI / (float)(nj - d);
+
+  // same model as the shore band in 'GerstnerWave::displace'
+  for (int k = 0; k < tile.shore_dist.shape[0]; k++)
+  {
+    const int    i = tile.i0 + k;
+    const float  x0 = -M_PI + (float)i * dx;
+    const float *p_h = &h(i < ni ? i : i - ni, 0);
+
+    for (int l = 0; l < tile.shore_dist.shape[1]; l++)
+    {
+      const int   j = tile.j0 + l;
+      const float y0 = -M_PI + (float)j * dy;
+
+      // land cells are not displaced
+      if (p_h[j < nj ? j : j - nj] >= 0.f)
+      {
+        tile.x_disp(k, l) = x0;
+        tile.y_disp(k, l) = y0;
+        tile.dz_disp(k, l) = 0.f;
+        continue;
+      }
+
+      float sd = tile.shore_dist(k, l);
+      float phi = kx * x0 + ky * y0 + phase + tile.phi_depth(k, l);
+
+      float rloc = w.r * (1.f - w.shore_r_ratio * sd);
+      rloc *= std::pow(sd, 0.2f);
+
+      float sp = std::sin(phi);
+      tile.x_disp(k, l) = x0 - rloc * sp * ca;
+      tile.y_disp(k, l) = y0 - rloc * sp * sa;
+      float dz0 = -rloc * std::cos(phi);
+
+      float ck = (1.f - sd) * w.kludge;
+      tile.dz_disp(k, l) = -rloc * std::cos(phi - ck * dz0);
+    }
+  }
+}
+
+float AdaptiveWave::sample_dz_disp(float u, float v) const
+{
+  const int ni = this->shape[0];
+  const int nj = this->shape[1];
+  int       p, q;
+  float     tu, tv;
+
+  if (this->coarse.periodic)
+  {
+    float uf = std::floor(u);
+    float vf = std::floor(v);
+    tu = u - uf;
+    tv = v - vf;
+    p = wrap((int)uf, ni);
+    q = wrap((int)vf, nj);
+  }
+  else
+  {
+    // zero outside the domain
+    if (u < 0.f || v < 0.f || u > (float)(ni - 1) || v > (float)(nj - 1))
+      return 0.f;
+
+    p = std::min(ni - 2, (int)u);
+    q = std::min(nj - 2, (int)v);
+    tu = u - (float)p;
+    tv = v - (float)q;
+  }
+
+  const int ts = this->tile_size;
+  const int index = this->tile_index[(p / ts) * this->ntj + q / ts];
+
+  if (index >= 0)
+  {
+    const ShoreTile &tile = this->tiles[index];
+    const Array     &a = tile.dz_disp;
+    const int        k = p - tile.i0;
+    const int        l = q - tile.j0;
+
+    return (1.f - tu) * ((1.f - tv) * a(k, l) + tv * a(k, l + 1)) +
+           tu * ((1.f - tv) * a(k + 1, l) + tv * a(k + 1, l + 1));
+  }
+
+  float uc, vc;
+  this->to_coarse((float)p + tu, (float)q + tv, uc, vc);
+  return interp_coarse(this->coarse.dz_disp, uc, vc, this->coarse.periodic);
+}
+
+void AdaptiveWave::generate(float t)
+{
+  this->generate(t,
+                 this->dz.data(),
+                 this->shape[1] * sizeof(float),
+                 sizeof(float));
+}
+
+void AdaptiveWave::generate(float     t,
+                            float    *p_out,
+                            ptrdiff_t stride_i,
+                            ptrdiff_t stride_j)
+{
+  // coarse elevation, and Lagrangian elevation used outside the tiles
+  // (the deep water detail is added at full resolution)
+  this->coarse.displace(t);
+  this->coarse.resample(this->coarse.dz.data(),
+                        this->coarse.shape[1] * sizeof(float),
+                        sizeof(float));
+
+#pragma omp parallel for schedule(dynamic, 1)
+  for (size_t k = 0; k < this->tiles.size(); k++)
+    this->displace_tile(this->tiles[k], t);
+
+  // --- resample on the full resolution grid
+
+  const int   d = this->coarse.periodic ? 0 : 1;
+  const float ax = (float)(this->shape[0] - d) / (2.f * M_PI);
+  const float ay = (float)(this->shape[1] - d) / (2.f * M_PI);
+  const int   ts = this->tile_size;
+  char       *p_base = (char *)p_out;
+
+  // coarse interpolation nodes of the columns
+  const Array       &dzc = this->coarse.dz;
+  std::vector<int>   q(this->shape[1]), q1(this->shape[1]);
+  std::vector<float> tv(this->shape[1]);
+
+  for (int j = 0; j < this->shape[1]; j++)
+  {
+    float uc, vc;
+    this->to_coarse(0.f, (float)j, uc, vc);
+    coarse_nodes(vc, dzc.shape[1], this->coarse.periodic, q[j], q1[j], tv[j]);
+  }
+
+#pragma omp parallel for schedule(dynamic, 16)
+  for (int i = 0; i < this->shape[0]; i++)
+  {
+    char *p_row = p_base + i * stride_i;
+
+    int   p, p1;
+    float tu, uc, vc;
+    this->to_coarse((float)i, 0.f, uc, vc);
+    coarse_nodes(uc, dzc.shape[0], this->coarse.periodic, p, p1, tu);
+
+    const float *p_c0 = &dzc(p, 0);
+    const float *p_c1 = &dzc(p1, 0);
+
+    for (int b = 0; b < this->ntj; b++)
+    {
+      const int index = this->tile_index[(i / ts) * this->ntj + b];
+      const int j1 = b * ts;
+      const int j2 = std::min(this->shape[1], j1 + ts);
+
+      if (index >= 0)
+      {
+        const ShoreTile &tile = this->tiles[index];
+        const float     *p_x = &tile.x_disp(i - tile.i0, 0);
+        const float     *p_y = &tile.y_disp(i - tile.i0, 0);
+
+        for (int j = j1; j < j2; j++)
+          *(float *)(p_row + j * stride_j) = this->sample_dz_disp(
+              ax * (p_x[j - tile.j0] + M_PI),
+              ay * (p_y[j - tile.j0] + M_PI));
+      }
+      else if (index == TILE_COARSE)
+        for (int j = j1; j < j2; j++)
+          *(float *)(p_row + j * stride_j) =
+              (1.f - tu) * ((1.f - tv[j]) * p_c0[q[j]] + tv[j] * p_c0[q1[j]]) +
+              tu * ((1.f - tv[j]) * p_c1[q[j]] + tv[j] * p_c1[q1[j]]);
+      else
+        for (int j = j1; j < j2; j++)
+          *(float *)(p_row + j * stride_j) = 0.f;
+    }
+  }
+
+  if (this->coarse.p_spectral)
+    this->add_spectral(t, p_out, stride_i, stride_j);
+}
+
+void AdaptiveWave::add_spectral(float     t,
+                                float    *p_out,
+                                ptrdiff_t stride_i,
+                                ptrdiff_t stride_j)
+{
+  SpectralOcean *p_spectral = this->coarse.p_spectral;
+  p_spectral->synthesize(t);
+
+  const int    d = this->coarse.periodic ? 0 : 1;
+  const float  dx = 2.f * M_PI / (float)(this->shape[0] - d);
+  const float  dy = 2.f * M_PI / (float)(this->shape[1] - d);
+  const int    ts = this->tile_size;
+  char        *p_base = (char *)p_out;
+  const Array &sdc = this->coarse.shore_dist;
+
+  std::vector<int>   q(this->shape[1]), q1(this->shape[1]);
+  std::vector<float> tv(this->shape[1]);
+
+  for (int j = 0; j < this->shape[1]; j++)
+  {
+    float uc, vc;
+    this->to_coarse(0.f, (float)j, uc, vc);
+    coarse_nodes(vc, sdc.shape[1], this->coarse.periodic, q[j], q1[j], tv[j]);
+  }
+
+  // weighted by the shore distance of the tiles, or of the coarse level
+  // in open water
+#pragma omp parallel for schedule(dynamic, 16)
+  for (int i = 0; i < this->shape[0]; i++)
+  {
+    char       *p_row = p_base + i * stride_i;
+    const float x = -M_PI + dx * (float)i;
+
+    int   p, p1;
+    float tu, uc, vc;
+    this->to_coarse((float)i, 0.f, uc, vc);
+    coarse_nodes(uc, sdc.shape[0], this->coarse.periodic, p, p1, tu);
+
+    const float *p_c0 = &sdc(p, 0);
+    const float *p_c1 = &sdc(p1, 0);
+
+    for (int b = 0; b < this->ntj; b++)
+    {
+      const int index = this->tile_index[(i / ts) * this->ntj + b];
+      const int j1 = b * ts;
+      const int j2 = std::min(this->shape[1], j1 + ts);
+
+      if (index >= 0)
+      {
+        const ShoreTile &tile = this->tiles[index];
+        const float     *p_sd = &tile.shore_dist(i - tile.i0, 0);
+
+        for (int j = j1; j < j2; j++)
+          *(float *)(p_row + j * stride_j) +=
+              p_sd[j - tile.j0] *
+              p_spectral->sample(x, -M_PI + dy * (float)j);
+      }
+      else if (index == TILE_COARSE)
+        for (int j = j1; j < j2; j++)
+        {
+          float sd = (1.f - tu) * ((1.f - tv[j]) * p_c0[q[j]] +
+                                   tv[j] * p_c0[q1[j]]) +
+                     tu * ((1.f - tv[j]) * p_c1[q[j]] + tv[j] * p_c1[q1[j]]);
+
+          *(float *)(p_row + j * stride_j) +=
+              sd * p_spectral->sample(x, -M_PI + dy * (float)j);
+        }
+    }
+  }
+}
+
+float AdaptiveWave::refined_fraction() const
+{
+  size_t n = 0;
+  for (auto &tile : this->tiles)
+    n += (size_t)std::min(this->tile_size, this->shape[0] - tile.i0) *
+         std::min(this->tile_size, this->shape[1] - tile.j0);
+
+  return (float)n / ((float)this->shape[0] * (float)this->shape[1]);
+}
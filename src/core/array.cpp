@@ -1,7 +1,10 @@
 // Copyright (c) 2023 Otto Link. Distributed under the terms of the
 // GNU General Public License. The full license is in the file
 // LICENSE, distributed with this software.
+#include <limits>
+
 #include "core/array.hpp"
+#include "core/stencil.hpp"
 
 float f(int i, float gi)
 {
@@ -13,133 +16,389 @@ int sep(int i, int u, float gi, float gu)
   return (int)((u * u - i * i + gu * gu - gi * gi) / (2 * (u - i)));
 }
 
-Array distance_transform(const Array &array)
+// A. Meijster, J. B. T. M. Roerdink, and W. H. Hesselink. A general
+// algorithm for computing distance transforms in linear time. In
+// Mathematical Morphology and its Applications to Image and Signal
+// Processing, pages 331–340. Kluwer Academic Publishers, 2000.
+//
+// In periodic mode, the row scans go twice around the domain and the
+// column scans run on three consecutive periods, only the middle one
+// being kept.
+
+// phase 1, distance to the nearest land cell on row 'i'
+static void dt_scan_row(const Array &array, float *p_g, int i, bool periodic)
 {
-  // A. Meijster, J. B. T. M. Roerdink, and W. H. Hesselink. A general
-  // algorithm for computing distance transforms in linear time. In
-  // Mathematical Morphology and its Applications to Image and Signal
-  // Processing, pages 331–340. Kluwer Academic Publishers, 2000.
+  const int    ni = array.shape[0];
+  const int    nj = array.shape[1];
+  const int    mj = periodic ? 2 * nj : nj;
+  const float  inf = (float)(ni + nj);
+  const float *p_a = &array(i, 0);
+
+  // scan 1
+  if (p_a[0] > 0.f)
+    p_g[0] = 0.f;
+  else
+    p_g[0] = inf;
+
+  for (int jj = 1; jj < mj; jj++)
+  {
+    int j = jj % nj;
+    int jp = (jj - 1) % nj;
 
-  Array dt = Array(array.shape); // output distance
+    if (p_a[j] > 0.f)
+      p_g[j] = 0.f;
+    else if (jj < nj)
+      p_g[j] = 1.f + p_g[jp];
+    else
+      p_g[j] = std::min(p_g[j], 1.f + p_g[jp]);
+  }
+
+  // scan 2
+  for (int jj = mj - 2; jj > -1; jj--)
+  {
+    int j = jj % nj;
+    int jn = (jj + 1) % nj;
+
+    if (p_g[jn] < p_g[j])
+      p_g[j] = 1.f + p_g[jn];
+  }
+}
+
+// phase 2, squared distance on column 'j' from the row distances of
+// the rows [w1, w2) only (indices modulo the number of rows, within one
+// period of the domain), stored on the rows [o1, o2). 's' and 't' are
+// scan buffers of size at least w2 - w1
+static void dt_scan(const Array      &g,
+                    Array            &dt,
+                    int               j,
+                    int               w1,
+                    int               w2,
+                    int               o1,
+                    int               o2,
+                    std::vector<int> &s,
+                    std::vector<int> &t)
+{
+  const int ni = g.shape[0];
+  const int mi = w2 - w1;
+
+  int q = 0;
+  s[0] = 0;
+  t[0] = 0;
+
+#define ROW(u) ((u) + w1 < 0 ? (u) + w1 + ni : ((u) + w1) % ni)
+#define G(u) g(ROW(u), j)
+
+  // scan 3
+  for (int u = 1; u < mi; u++)
+  {
+    while ((q >= 0) and (f(t[q] - s[q], G(s[q])) > f(t[q] - u, G(u))))
+      q--;
+
+    if (q < 0)
+    {
+      q = 0;
+      s[0] = u;
+    }
+    else
+    {
+      int w = 1 + sep(s[q], u, G(s[q]), G(u));
+
+      if (w < mi)
+      {
+        q++;
+        s[q] = u;
+        t[q] = w;
+      }
+    }
+  }
+
+  // scan 4
+  for (int u = mi - 1; u > -1; u--)
+  {
+    if (u + w1 >= o1 and u + w1 < o2)
+      dt(ROW(u), j) = f(u - s[q], G(s[q]));
+    if (u == t[q])
+      q--;
+  }
+
+#undef G
+#undef ROW
+}
+
+static void dt_scan_column(const Array      &g,
+                           Array            &dt,
+                           int               j,
+                           bool              periodic,
+                           std::vector<int> &s,
+                           std::vector<int> &t)
+{
+  const int ni = g.shape[0];
+
+  if (periodic)
+    dt_scan(g, dt, j, -ni, 2 * ni, 0, ni, s, t);
+  else
+    dt_scan(g, dt, j, 0, ni, 0, ni, s, t);
+}
+
+Array distance_transform(const Array &array, bool periodic)
+{
   Array g = Array(array.shape);
+  return distance_transform(array, g, periodic);
+}
+
+Array distance_transform(const Array &array, Array &g, bool periodic)
+{
+  Array dt = Array(array.shape); // output distance
   int   ni = array.shape[0];
   int   nj = array.shape[1];
-  float inf = (float)(ni + nj);
 
-  // phase 1
+  g.set_shape(array.shape);
+
+  // phase 1 (rows are independent)
+#pragma omp parallel for schedule(static)
   for (int i = 0; i < ni; i++)
-  {
-    // scan 1
-    if (array(i, 0) > 0.f)
-      g(i, 0) = 0.f;
-    else
-      g(i, 0) = inf;
+    dt_scan_row(array, &g(i, 0), i, periodic);
 
-    for (int j = 1; j < nj; j++)
-    {
-      if (array(i, j) > 0.f)
-        g(i, j) = 0.f;
-      else
-        g(i, j) = 1.f + g(i, j - 1);
-    }
+  // phase 2 (columns are independent, scan buffers are thread-private)
+  const int mi = periodic ? 3 * ni : ni;
+
+#pragma omp parallel
+  {
+    std::vector<int> s(std::max(mi, nj));
+    std::vector<int> t(std::max(mi, nj));
 
-    // scan 2
-    for (int j = nj - 2; j > -1; j--)
-      if (g(i, j + 1) < g(i, j))
-        g(i, j) = 1.f + g(i, j + 1);
+#pragma omp for schedule(static)
+    for (int j = 0; j < nj; j++)
+      dt_scan_column(g, dt, j, periodic, s, t);
   }
 
-  // phase 2
-  std::vector<int> s(std::max(ni, nj));
-  std::vector<int> t(std::max(ni, nj));
+  return dt;
+}
 
-  for (int j = 0; j < nj; j++)
+void distance_transform_update_rows(const Array &array,
+                                    Array       &g,
+                                    int          i1,
+                                    int          i2,
+                                    bool         periodic,
+                                    int         &j1,
+                                    int         &j2)
+{
+  int nj = array.shape[1];
+  int jmin = nj;
+  int jmax = -1;
+
+#pragma omp parallel reduction(min : jmin) reduction(max : jmax)
   {
-    int q = 0;
-    s[0] = 0;
-    t[0] = 0;
+    std::vector<float> row(nj);
 
-    // scan 3
-    for (int u = 1; u < ni; u++)
+#pragma omp for schedule(static)
+    for (int i = i1; i < i2; i++)
     {
-      while ((q >= 0) and (f(t[q] - s[q], g(s[q], j)) > f(t[q] - u, g(u, j))))
-        q--;
+      float *p_g = &g(i, 0);
 
-      if (q < 0)
-      {
-        q = 0;
-        s[0] = u;
-      }
-      else
-      {
-        int w = 1 + sep(s[q], u, g(s[q], j), g(u, j));
+      dt_scan_row(array, row.data(), i, periodic);
 
-        if (w < ni)
+      for (int j = 0; j < nj; j++)
+        if (row[j] != p_g[j])
         {
-          q++;
-          s[q] = u;
-          t[q] = w;
+          jmin = std::min(jmin, j);
+          jmax = std::max(jmax, j);
+          p_g[j] = row[j];
         }
-      }
     }
+  }
+
+  j1 = jmax < 0 ? 0 : jmin;
+  j2 = jmax < 0 ? 0 : jmax + 1;
+}
+
+void distance_transform_update_column(const Array &g,
+                                      Array       &dt,
+                                      int          j,
+                                      int          i1,
+                                      int          i2,
+                                      bool         periodic,
+                                      int         &u1,
+                                      int         &u2)
+{
+  const int ni = g.shape[0];
+
+  // in periodic mode, the walks away from the modified rows stop halfway
+  // around the domain
+  const int half = periodic ? (ni - (i2 - i1)) / 2 : ni;
+
+  auto dt_at = [&dt, ni, j](int u) { return dt(u < 0 ? u + ni : u % ni, j); };
+  auto sq = [](int d) { return (float)d * (float)d; };
+
+  // rows where the distance can change, those closer to the modified
+  // rows than to the shore: since the distance is 1-Lipschitz, they form
+  // an interval around the modified rows
+  int c1 = i1;
+  int c2 = i2;
 
-    // scan 4
-    for (int u = ni - 1; u > -1; u--)
+  while ((periodic or c1 > 0) and i1 - c1 < half and
+         sq(i1 - c1 + 1) <= dt_at(c1 - 1))
+    c1--;
+
+  while ((periodic or c2 < ni) and c2 - i2 < half and
+         sq(c2 - i2 + 1) <= dt_at(c2))
+    c2++;
+
+  // rescan on a window around these rows, widened until their new
+  // distances are closer than the rows outside of the window
+  for (int m = std::max(16, c2 - c1);; m *= 2)
+  {
+    int w1 = periodic ? c1 - m : std::max(0, c1 - m);
+    int w2 = periodic ? c2 + m : std::min(ni, c2 + m);
+
+    if (periodic and (i1 - c1 >= half or c2 - i2 >= half or w2 - w1 >= ni))
     {
-      dt(u, j) = f(u - s[q], g(s[q], j));
-      if (u == t[q])
-        q--;
+      std::vector<int> s(3 * ni);
+      std::vector<int> t(3 * ni);
+      dt_scan(g, dt, j, -ni, 2 * ni, 0, ni, s, t);
+      u1 = 0;
+      u2 = ni;
+      return;
     }
+
+    std::vector<int> s(w2 - w1);
+    std::vector<int> t(w2 - w1);
+    dt_scan(g, dt, j, w1, w2, c1, c2, s, t);
+
+    const bool open1 = periodic or w1 > 0;
+    const bool open2 = periodic or w2 < ni;
+    bool       certified = true;
+
+    for (int u = c1; u < c2 and certified; u++)
+      certified = (!open1 or dt_at(u) <= sq(u - w1 + 1)) and
+                  (!open2 or dt_at(u) <= sq(w2 - u));
+
+    if (certified)
+      break;
   }
 
-  return dt;
+  u1 = c1;
+  u2 = c2;
 }
 
-Array gradient_angle(const Array &array)
+// fused gradient / angle kernel (single sweep)
+struct KernelGradientAngle
 {
-  Array dx = gradient_x(array);
-  Array dy = gradient_y(array);
-  Array alpha = Array(array.shape);
+  static const int radius = 1;
+  StencilGradientX gx;
+  StencilGradientY gy;
+  float           *p_out;
 
-  std::transform(dx.vector.begin(),
-                 dx.vector.end(),
-                 dy.vector.begin(),
-                 alpha.vector.begin(),
-                 [](float a, float b) { return std::atan2(b, a); });
+  template <class A> inline void operator()(const A &a, int k) const
+  {
+    p_out[k] = std::atan2(gy(a), gx(a));
+  }
+};
 
+Array gradient_angle(const Array &array, bool periodic)
+{
+  Array               alpha = Array(array.shape);
+  KernelGradientAngle kernel = {StencilGradientX(),
+                                StencilGradientY(),
+                                alpha.data()};
+  if (periodic)
+    stencil_sweep<BoundaryPeriodic>(array, kernel);
+  else
+    stencil_sweep<BoundaryExtrapolate>(array, kernel);
   return alpha;
 }
 
-Array gradient_x(const Array &array)
+Array gradient_x(const Array &array, bool periodic)
 {
-  Array dx = Array(array.shape);
-  for (int i = 1; i < array.shape[0] - 1; i++)
-    for (int j = 0; j < array.shape[1]; j++)
-      dx(i, j) = 0.5f * (array(i + 1, j) - array(i - 1, j));
+  if (periodic)
+    return apply_stencil<StencilGradientX, BoundaryPeriodic>(array);
+  else
+    return apply_stencil<StencilGradientX>(array);
+}
+
+Array gradient_y(const Array &array, bool periodic)
+{
+  if (periodic)
+    return apply_stencil<StencilGradientY, BoundaryPeriodic>(array);
+  else
+    return apply_stencil<StencilGradientY>(array);
+}
+
+Array laplacian(const Array &array, bool periodic)
+{
+  if (periodic)
+    return apply_stencil<StencilLaplacian, BoundaryPeriodic>(array);
+  else
+    return apply_stencil<StencilLaplacian>(array);
+}
 
-  for (int j = 0; j < array.shape[1]; j++)
+void Array::update_stats() const
+{
+  if (this->stats_valid.load(std::memory_order_acquire))
+    return;
+
+  const int    n = (int)this->vector.size();
+  const float *p = this->vector.data();
+  float        vmin = std::numeric_limits<float>::max();
+  float        vmax = -std::numeric_limits<float>::max();
+  double       sum = 0.0;
+
+#pragma omp parallel for schedule(static) reduction(min : vmin)                \
+    reduction(max : vmax) reduction(+ : sum)
+  for (int k = 0; k < n; k++)
   {
-    dx(0, j) = array(1, j) - array(0, j);
-    dx(array.shape[0] - 1, j) =
-        array(array.shape[0] - 1, j) - array(array.shape[0] - 2, j);
+    vmin = std::min(vmin, p[k]);
+    vmax = std::max(vmax, p[k]);
+    sum += (double)p[k];
   }
-  return dx;
+
+  this->stats.min = vmin;
+  this->stats.max = vmax;
+  this->stats.mean = n > 0 ? (float)(sum / (double)n) : 0.f;
+  this->hist.clear();
+  this->stats_valid.store(true, std::memory_order_release);
+}
+
+ArrayStats Array::get_stats() const
+{
+  if (this->stats_valid.load(std::memory_order_acquire))
+    return this->stats;
+
+  std::lock_guard<std::mutex> lock(this->stats_mutex);
+  this->update_stats();
+  return this->stats;
 }
 
-Array gradient_y(const Array &array)
+std::vector<int> Array::histogram(int nbins) const
 {
-  Array dy = Array(array.shape);
-  for (int i = 0; i < array.shape[0]; i++)
-    for (int j = 1; j < array.shape[1] - 1; j++)
-      dy(i, j) = 0.5f * (array(i, j + 1) - array(i, j - 1));
+  std::lock_guard<std::mutex> lock(this->stats_mutex);
+  this->update_stats();
 
-  for (int i = 0; i < array.shape[0]; i++)
+  if ((int)this->hist.size() == nbins)
+    return this->hist;
+
+  const ArrayStats &st = this->stats;
+  const int         n = (int)this->vector.size();
+  const float      *p = this->vector.data();
+  const float       a = st.max > st.min ? (float)nbins / (st.max - st.min)
+                                        : 0.f;
+
+  this->hist.assign(nbins, 0);
+
+#pragma omp parallel
   {
-    dy(i, 0) = array(i, 1) - array(i, 0);
-    dy(i, array.shape[1] - 1) =
-        array(i, array.shape[1] - 1) - array(i, array.shape[1] - 2);
+    std::vector<int> hist_private(nbins, 0);
+
+#pragma omp for schedule(static) nowait
+    for (int k = 0; k < n; k++)
+      hist_private[std::min(nbins - 1, (int)(a * (p[k] - st.min)))]++;
+
+#pragma omp critical
+    for (int b = 0; b < nbins; b++)
+      this->hist[b] += hist_private[b];
   }
-  return dy;
+
+  return this->hist;
 }
 
 Array interp_nearest(const Array &x,
@@ -161,6 +420,9 @@ Array interp_nearest(const Array &x,
   float bx = -xmin * (shape[0] - 1) / (xmax - xmin);
   float by = -ymin * (shape[1] - 1) / (ymax - ymin);
 
+  float *p_zi = zi.data();
+
+#pragma omp parallel for schedule(static)
   for (int i = 0; i < shape[0]; i++)
     for (int j = 0; j < shape[1]; j++)
     {
@@ -172,13 +434,13 @@ Array interp_nearest(const Array &x,
       p = std::min(shape[0] - 1, p);
       q = std::min(shape[1] - 1, q);
 
-      zi(i, j) = z(p, q);
+      p_zi[i * shape[1] + j] = z(p, q);
     }
 
   return zi;
 }
 
-std::vector<uint8_t> Array::to_img_8bit_grayscale()
+std::vector<uint8_t> Array::to_img_8bit_grayscale() const
 {
   std::vector<uint8_t> data(this->shape[0] * this->shape[1]);
   const float          vmax = this->max();
@@ -203,7 +465,7 @@ std::vector<uint8_t> Array::to_img_8bit_grayscale()
   return data;
 }
 
-std::vector<uint8_t> Array::to_img_8bit_rgb(Array *p_mask)
+std::vector<uint8_t> Array::to_img_8bit_rgb(const Array *p_mask) const
 {
   std::vector<uint8_t> data(this->shape[0] * this->shape[1] * 3);
   const float          vmax = this->max();
@@ -260,44 +522,3 @@ std::vector<uint8_t> Array::to_img_8bit_rgb(Array *p_mask)
   }
   return data;
 }
-
-void Array::to_texture(GLuint &image_texture, int colormap, Array *p_mask)
-{
-  glBindTexture(GL_TEXTURE_2D, image_texture);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-  // Upload pixels into texture
-#if defined(GL_UNPACK_ROW_LENGTH) && !defined(__EMSCRIPTEN__)
-  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
-#endif
-
-  switch (colormap)
-  {
-  case 0:
-    glTexImage2D(GL_TEXTURE_2D,
-                 0,
-                 GL_RGBA,
-                 this->shape[0],
-                 this->shape[1],
-                 0,
-                 GL_LUMINANCE,
-                 GL_UNSIGNED_BYTE,
-                 this->to_img_8bit_grayscale().data());
-    break;
-
-  case 1:
-    glTexImage2D(GL_TEXTURE_2D,
-                 0,
-                 GL_RGBA,
-                 this->shape[0],
-                 this->shape[1],
-                 0,
-                 GL_RGB,
-                 GL_UNSIGNED_BYTE,
-                 this->to_img_8bit_rgb(p_mask).data());
-    break;
-  }
-}
@@ -0,0 +1,116 @@
+// Copyright (c) 2023 Otto Link. Distributed under the terms of the
+// GNU General Public License. The full license is in the file
+// LICENSE, distributed with this software.
+#include <algorithm>
+#include <cmath>
+
+#include "core/block_compression.hpp"
+
+void encode_bc4_block(const float *p_values, uint8_t *p_block)
+{
+  float v[16];
+  float vmin = 255.f;
+  float vmax = 0.f;
+
+  for (int k = 0; k < 16; k++)
+  {
+    v[k] = 255.f * std::min(1.f, std::max(0.f, p_values[k]));
+    vmin = std::min(vmin, v[k]);
+    vmax = std::max(vmax, v[k]);
+  }
+
+  // 8-value mode (endpoint 0 > endpoint 1)
+  int r0 = (int)std::ceil(vmax);
+  int r1 = (int)std::floor(vmin);
+
+  if (r0 == r1)
+  {
+    if (r0 < 255)
+      r0++;
+    else
+      r1--;
+  }
+
+  p_block[0] = (uint8_t)r0;
+  p_block[1] = (uint8_t)r1;
+
+  // 3-bit indices, texel 0 in the least significant bits. Palette
+  // position q in [0, 7] from r1 to r0 maps to index 1 (q = 0), 0 (q =
+  // 7) or 8 - q
+  uint64_t bits = 0;
+  float    a = 7.f / (float)(r0 - r1);
+
+  for (int k = 0; k < 16; k++)
+  {
+    int      q = (int)std::floor(a * (v[k] - (float)r1) + 0.5f);
+    uint64_t idx = q == 0 ? 1 : q == 7 ? 0 : 8 - q;
+    bits |= idx << (3 * k);
+  }
+
+  for (int b = 0; b < 6; b++)
+    p_block[2 + b] = (uint8_t)(bits >> (8 * b));
+}
+
+// gather the 4x4 block (bi, bj) of a plane, clamping at the borders
+static void load_block(const std::vector<float> &plane,
+                       int                       width,
+                       int                       height,
+                       int                       bi,
+                       int                       bj,
+                       float                    *p_values)
+{
+  for (int r = 0; r < 4; r++)
+  {
+    int row = std::min(height - 1, 4 * bj + r);
+    for (int c = 0; c < 4; c++)
+    {
+      int col = std::min(width - 1, 4 * bi + c);
+      p_values[4 * r + c] = plane[row * width + col];
+    }
+  }
+}
+
+std::vector<uint8_t> compress_bc4(const std::vector<float> &plane,
+                                  int                       width,
+                                  int                       height)
+{
+  const int            nbi = (width + 3) / 4;
+  const int            nbj = (height + 3) / 4;
+  std::vector<uint8_t> data(8 * nbi * nbj);
+
+#pragma omp parallel for schedule(static)
+  for (int bj = 0; bj < nbj; bj++)
+    for (int bi = 0; bi < nbi; bi++)
+    {
+      float values[16];
+      load_block(plane, width, height, bi, bj, values);
+      encode_bc4_block(values, &data[8 * (bj * nbi + bi)]);
+    }
+
+  return data;
+}
+
+std::vector<uint8_t> compress_bc5(const std::vector<float> &plane_r,
+                                  const std::vector<float> &plane_g,
+                                  int                       width,
+                                  int                       height)
+{
+  const int            nbi = (width + 3) / 4;
+  const int            nbj = (height + 3) / 4;
+  std::vector<uint8_t> data(16 * nbi * nbj);
+
+#pragma omp parallel for schedule(static)
+  for (int bj = 0; bj < nbj; bj++)
+    for (int bi = 0; bi < nbi; bi++)
+    {
+      float values[16];
+      int   k = 16 * (bj * nbi + bi);
+
+      load_block(plane_r, width, height, bi, bj, values);
+      encode_bc4_block(values, &data[k]);
+      load_block(plane_g, width, height, bi, bj, values);
+      encode_bc4_block(values, &data[k + 8]);
+    }
+
+  return data;
+}
@@ -15,7 +15,8 @@ Array fbm_perlin(std::vector<int>   shape,
                  float              weight,
                  float              persistence,
                  float              lacunarity,
-                 std::vector<float> shift)
+                 std::vector<float> shift,
+                 bool               periodic)
 {
   Array         array = Array(shape);
   FastNoiseLite noise(seed);
@@ -31,10 +32,37 @@ Array fbm_perlin(std::vector<int>   shape,
   float ki = kw[0] / (float)shape[0];
   float kj = kw[1] / (float)shape[1];
 
-  for (int i = 0; i < array.shape[0]; i++)
-    for (int j = 0; j < array.shape[1]; j++)
-      array(i, j) =
-          noise.GetNoise(ki * (float)i + shift[0], kj * (float)j + shift[1]);
+  if (!periodic)
+  {
+    for (int i = 0; i < array.shape[0]; i++)
+      for (int j = 0; j < array.shape[1]; j++)
+        array(i, j) =
+            noise.GetNoise(ki * (float)i + shift[0], kj * (float)j + shift[1]);
+  }
+  else
+  {
+    // tileable noise, bilinear blend of the noise and of its copies
+    // shifted by one period in each direction
+    float wi = kw[0];
+    float wj = kw[1];
+
+    for (int i = 0; i < array.shape[0]; i++)
+      for (int j = 0; j < array.shape[1]; j++)
+      {
+        float x = ki * (float)i;
+        float y = kj * (float)j;
+        float u = (float)i / (float)shape[0];
+        float v = (float)j / (float)shape[1];
+
+        x += shift[0];
+        y += shift[1];
+
+        array(i, j) = (1.f - u) * (1.f - v) * noise.GetNoise(x, y) +
+                      u * (1.f - v) * noise.GetNoise(x - wi, y) +
+                      (1.f - u) * v * noise.GetNoise(x, y - wj) +
+                      u * v * noise.GetNoise(x - wi, y - wj);
+      }
+  }
 
   return array;
 }
@@ -0,0 +1,174 @@
+// Copyright (c) 2023 Otto Link. Distributed under the terms of the
+// GNU General Public License. The full license is in the file
+// LICENSE, distributed with this software.
+#include "core/fft.hpp"
+
+typedef std::complex<float> cfloat;
+
+bool is_power_of_two(int n)
+{
+  return n > 0 and (n & (n - 1)) == 0;
+}
+
+FFTPlan::FFTPlan(int n) : n(n)
+{
+  this->log2n = 0;
+  while ((1 << this->log2n) < n)
+    this->log2n++;
+
+  this->bit_reversal.resize(n);
+  for (int k = 0; k < n; k++)
+  {
+    int r = 0;
+    for (int b = 0; b < this->log2n; b++)
+      r |= ((k >> b) & 1) << (this->log2n - 1 - b);
+    this->bit_reversal[k] = r;
+  }
+
+  this->twiddle.resize(std::max(1, n / 2));
+  for (int k = 0; k < n / 2; k++)
+  {
+    double a = -2.0 * M_PI * (double)k / (double)n;
+    this->twiddle[k] = cfloat((float)std::cos(a), (float)std::sin(a));
+  }
+}
+
+void FFTPlan::execute(cfloat *p_data, bool inverse) const
+{
+  const int n = this->n;
+
+  for (int k = 0; k < n; k++)
+    if (k < this->bit_reversal[k])
+      std::swap(p_data[k], p_data[this->bit_reversal[k]]);
+
+  int q = 1; // size of the transformed sub-blocks
+
+  if (this->log2n % 2)
+  {
+    for (int k = 0; k < n; k += 2)
+    {
+      cfloat a = p_data[k];
+      cfloat b = p_data[k + 1];
+      p_data[k] = a + b;
+      p_data[k + 1] = a - b;
+    }
+    q = 2;
+  }
+
+  // radix-4 butterflies, as two fused radix-2 stages: the four
+  // sub-blocks of size q are combined into a block of size 4 q
+  for (; q < n; q *= 4)
+  {
+    const int step = n / (4 * q);
+
+    for (int b = 0; b < n; b += 4 * q)
+    {
+      cfloat *p = p_data + b;
+
+      for (int j = 0; j < q; j++)
+      {
+        cfloat w1 = this->twiddle[j * step];     // W_4q^j
+        cfloat w2 = this->twiddle[2 * j * step]; // W_4q^2j
+        if (inverse)
+        {
+          w1 = std::conj(w1);
+          w2 = std::conj(w2);
+        }
+
+        cfloat a0 = p[j];
+        cfloat a1 = p[j + q] * w2;
+        cfloat a2 = p[j + 2 * q];
+        cfloat a3 = p[j + 3 * q] * w2;
+
+        cfloat t0 = a0 + a1;
+        cfloat t1 = a0 - a1;
+        cfloat t2 = (a2 + a3) * w1;
+        cfloat t3 = (a2 - a3) * w1;
+
+        // times W_4 = -i (forward) or i (inverse)
+        t3 = inverse ? cfloat(-t3.imag(), t3.real())
+                     : cfloat(t3.imag(), -t3.real());
+
+        p[j] = t0 + t2;
+        p[j + q] = t1 + t3;
+        p[j + 2 * q] = t0 - t2;
+        p[j + 3 * q] = t1 - t3;
+      }
+    }
+  }
+}
+
+void irfft2d(std::vector<cfloat> &spectrum,
+             Array               &out,
+             const FFTPlan       &plan_i,
+             const FFTPlan       &plan_j)
+{
+  const int ni = out.shape[0];
+  const int nj = out.shape[1];
+  const int nh = nj / 2;
+  const int nc = nh + 1; // half spectrum columns
+
+  // --- columns, gathered by blocks into contiguous buffers
+
+  const int nblocks = (nc + FFT_COLUMN_BLOCK - 1) / FFT_COLUMN_BLOCK;
+
+#pragma omp parallel
+  {
+    std::vector<cfloat> buffer(FFT_COLUMN_BLOCK * ni);
+
+#pragma omp for schedule(dynamic, 1)
+    for (int blk = 0; blk < nblocks; blk++)
+    {
+      const int c1 = blk * FFT_COLUMN_BLOCK;
+      const int nb = std::min(FFT_COLUMN_BLOCK, nc - c1);
+
+      for (int i = 0; i < ni; i++)
+        for (int b = 0; b < nb; b++)
+          buffer[b * ni + i] = spectrum[i * nc + c1 + b];
+
+      for (int b = 0; b < nb; b++)
+        plan_i.execute(buffer.data() + b * ni, true);
+
+      for (int i = 0; i < ni; i++)
+        for (int b = 0; b < nb; b++)
+          spectrum[i * nc + c1 + b] = buffer[b * ni + i];
+    }
+  }
+
+  // --- rows, the real row of size nj is the half-size complex
+  // --- transform of its even (real part) and odd (imaginary part)
+  // --- samples
+
+  std::vector<cfloat> phase(nh);
+  for (int k = 0; k < nh; k++)
+  {
+    double a = 2.0 * M_PI * (double)k / (double)nj;
+    phase[k] = cfloat((float)-std::sin(a), (float)std::cos(a)); // i e^(ia)
+  }
+
+#pragma omp parallel
+  {
+    std::vector<cfloat> z(nh);
+
+#pragma omp for schedule(static)
+    for (int i = 0; i < ni; i++)
+    {
+      const cfloat *p_x = spectrum.data() + i * nc;
+      float        *p_row = &out(i, 0);
+
+      for (int k = 0; k < nh; k++)
+      {
+        cfloat xc = std::conj(p_x[nh - k]);
+        z[k] = (p_x[k] + xc) + phase[k] * (p_x[k] - xc);
+      }
+
+      plan_j.execute(z.data(), true);
+
+      for (int k = 0; k < nh; k++)
+      {
+        p_row[2 * k] = z[k].real();
+        p_row[2 * k + 1] = z[k].imag();
+      }
+    }
+  }
+}
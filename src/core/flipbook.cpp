@@ -0,0 +1,130 @@
+// Copyright (c) 2023 Otto Link. Distributed under the terms of the
+// GNU General Public License. The full license is in the file
+// LICENSE, distributed with this software.
+#include <cstdio>
+#include <vector>
+
+#include "macrologger.h"
+
+#include "core/array.hpp"
+#include "core/block_compression.hpp"
+#include "core/flipbook.hpp"
+
+#define DXGI_FORMAT_BC4_UNORM 80
+#define DXGI_FORMAT_BC5_UNORM 83
+
+static bool write_dds(std::string                 fname,
+                      int                         width,
+                      int                         height,
+                      int                         array_size,
+                      uint32_t                    dxgi_format,
+                      const std::vector<uint8_t> &data)
+{
+  FILE *fp = std::fopen(fname.c_str(), "wb");
+  if (!fp)
+    return false;
+
+  uint32_t block_size = dxgi_format == DXGI_FORMAT_BC4_UNORM ? 8 : 16;
+  uint32_t linear_size = block_size * ((width + 3) / 4) * ((height + 3) / 4);
+
+  // DDS_HEADER (124 bytes) followed by DDS_HEADER_DXT10 (20 bytes)
+  uint32_t header[31] = {0};
+  header[0] = 124;
+  // flags: caps, height, width, pixel format, linear size
+  header[1] = 0x1 | 0x2 | 0x4 | 0x1000 | 0x80000;
+  header[2] = (uint32_t)height;
+  header[3] = (uint32_t)width;
+  header[4] = linear_size;
+  header[6] = 1;           // mipmap count
+  header[18] = 32;         // pixel format size
+  header[19] = 0x4;        // DDPF_FOURCC
+  header[20] = 0x30315844; // "DX10"
+  header[26] = 0x1000;     // DDSCAPS_TEXTURE
+
+  uint32_t header_dx10[5] = {dxgi_format,
+                             3, // texture 2D
+                             0,
+                             (uint32_t)array_size,
+                             0};
+
+  bool ok = std::fwrite("DDS ", 1, 4, fp) == 4;
+  ok = ok and std::fwrite(header, sizeof(uint32_t), 31, fp) == 31;
+  ok = ok and std::fwrite(header_dx10, sizeof(uint32_t), 5, fp) == 5;
+  ok = ok and std::fwrite(data.data(), 1, data.size(), fp) == data.size();
+
+  return (std::fclose(fp) == 0) and ok;
+}
+
+bool export_flipbook(GerstnerWave &wave, int nframes, std::string basename)
+{
+  const int   width = wave.shape[0];
+  const int   height = wave.shape[1];
+  const int   n = width * height;
+  const float period = 2.f * M_PI / wave.omega;
+  const float a = 0.5f / wave.r;
+
+  // grid spacing, world units
+  const float dx = 2.f * M_PI / (float)(wave.periodic ? width : width - 1);
+  const float dy = 2.f * M_PI / (float)(wave.periodic ? height : height - 1);
+
+  std::vector<uint8_t> data_height;
+  std::vector<uint8_t> data_normal;
+  std::vector<float>   plane_h(n);
+  std::vector<float>   plane_nx(n);
+  std::vector<float>   plane_ny(n);
+  Array                dz = Array(wave.shape);
+
+  for (int k = 0; k < nframes; k++)
+  {
+    float t = period * (float)k / (float)nframes;
+    wave.generate(t, dz.data(), height * sizeof(float), sizeof(float));
+
+    Array gx = gradient_x(dz, wave.periodic);
+    Array gy = gradient_y(dz, wave.periodic);
+
+#pragma omp parallel for schedule(static)
+    for (int j = 0; j < height; j++)
+      for (int i = 0; i < width; i++)
+      {
+        int   p = (height - 1 - j) * width + i; // texel index
+        float nx = -gx(i, j) / dx;
+        float ny = -gy(i, j) / dy;
+        float norm = 1.f / std::sqrt(nx * nx + ny * ny + 1.f);
+
+        plane_h[p] = a * dz(i, j) + 0.5f;
+        plane_nx[p] = 0.5f * nx * norm + 0.5f;
+        plane_ny[p] = 0.5f * ny * norm + 0.5f;
+      }
+
+    std::vector<uint8_t> bc4 = compress_bc4(plane_h, width, height);
+    std::vector<uint8_t> bc5 = compress_bc5(plane_nx, plane_ny, width, height);
+    data_height.insert(data_height.end(), bc4.begin(), bc4.end());
+    data_normal.insert(data_normal.end(), bc5.begin(), bc5.end());
+  }
+
+  std::string fname_height = basename + "_height.dds";
+  std::string fname_normal = basename + "_normal.dds";
+
+  if (!write_dds(fname_height,
+                 width,
+                 height,
+                 nframes,
+                 DXGI_FORMAT_BC4_UNORM,
+                 data_height) or
+      !write_dds(fname_normal,
+                 width,
+                 height,
+                 nframes,
+                 DXGI_FORMAT_BC5_UNORM,
+                 data_normal))
+  {
+    LOG_ERROR("flipbook export failed (%s)", basename.c_str());
+    return false;
+  }
+
+  LOG_INFO("flipbook exported: %s, %s (%d frames)",
+           fname_height.c_str(),
+           fname_normal.c_str(),
+           nframes);
+  return true;
+}
@@ -0,0 +1,346 @@
+// Copyright (c) 2023 Otto Link. Distributed under the terms of the
+// GNU General Public License. The full license is in the file
+// LICENSE, distributed with this software.
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "macrologger.h"
+
+#include "core/frame_publisher.hpp"
+
+static_assert(sizeof(FrameRingHeader) <= FRAME_RING_HEADER_SIZE,
+              "ring header too large");
+static_assert(sizeof(FrameSlotHeader) <= FRAME_SLOT_HEADER_SIZE,
+              "slot header too large");
+
+#define READ_MAX_RETRIES 8
+
+static inline FrameSlotHeader *get_slot(FrameRingHeader *p_header, int k)
+{
+  return (FrameSlotHeader *)((char *)p_header + FRAME_RING_HEADER_SIZE +
+                             k * p_header->slot_size);
+}
+
+static inline const FrameSlotHeader *get_slot(const FrameRingHeader *p_header,
+                                              int                    k)
+{
+  return (const FrameSlotHeader *)((const char *)p_header +
+                                   FRAME_RING_HEADER_SIZE +
+                                   k * p_header->slot_size);
+}
+
+static inline float *get_data(FrameSlotHeader *p_slot)
+{
+  return (float *)((char *)p_slot + FRAME_SLOT_HEADER_SIZE);
+}
+
+static inline const float *get_data(const FrameSlotHeader *p_slot)
+{
+  return (const float *)((const char *)p_slot + FRAME_SLOT_HEADER_SIZE);
+}
+
+// --- publisher
+
+FramePublisher::~FramePublisher()
+{
+  this->close();
+}
+
+bool FramePublisher::open(std::string name, std::vector<int> shape, int nslots)
+{
+  this->close();
+
+  if (shape.size() != 2 or shape[0] < 1 or shape[1] < 1 or nslots < 2)
+    return false;
+
+  const size_t slot_size = FRAME_SLOT_HEADER_SIZE +
+                           (size_t)shape[0] * shape[1] * sizeof(float);
+  const size_t size = FRAME_RING_HEADER_SIZE + nslots * slot_size;
+
+  // an existing ring is never replaced, it may belong to another
+  // publisher
+  int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0)
+  {
+    if (errno == EEXIST)
+      LOG_ERROR("shared memory already in use (%s), by another publisher or "
+                "left over by a previous run (to be removed from /dev/shm)",
+                name.c_str());
+    else
+      LOG_ERROR("shared memory not created (%s)", name.c_str());
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+  {
+    LOG_ERROR("shared memory not created (%s)", name.c_str());
+    ::close(fd);
+    shm_unlink(name.c_str());
+    return false;
+  }
+
+  if (ftruncate(fd, (off_t)size) != 0)
+  {
+    LOG_ERROR("shared memory not allocated (%s)", name.c_str());
+    ::close(fd);
+    shm_unlink(name.c_str());
+    return false;
+  }
+
+  void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd); // the mapping remains valid
+
+  if (p == MAP_FAILED)
+  {
+    LOG_ERROR("shared memory not mapped (%s)", name.c_str());
+    shm_unlink(name.c_str());
+    return false;
+  }
+
+  // the memory is zero-initialized by ftruncate
+  FrameRingHeader *p_header = new (p) FrameRingHeader();
+  p_header->version = FRAME_RING_VERSION;
+  p_header->ni = shape[0];
+  p_header->nj = shape[1];
+  p_header->nslots = (uint32_t)nslots;
+  p_header->slot_size = slot_size;
+  p_header->closed.store(0, std::memory_order_relaxed);
+  p_header->nframes.store(0, std::memory_order_relaxed);
+
+  for (int k = 0; k < nslots; k++)
+    new (get_slot(p_header, k)) FrameSlotHeader();
+
+  // readers check the magic number last
+  std::atomic_thread_fence(std::memory_order_release);
+  p_header->magic = FRAME_RING_MAGIC;
+
+  this->name = name;
+  this->nslots = nslots;
+  this->size = size;
+  this->dev = (uint64_t)st.st_dev;
+  this->ino = (uint64_t)st.st_ino;
+  this->p_header = p_header;
+
+  LOG_INFO("frame publisher: %s (%d x %d, %d slots)",
+           name.c_str(),
+           shape[0],
+           shape[1],
+           nslots);
+  return true;
+}
+
+void FramePublisher::close()
+{
+  if (!this->p_header)
+    return;
+
+  this->p_header->closed.store(1, std::memory_order_release);
+  munmap(this->p_header, this->size);
+  this->p_header = nullptr;
+
+  // only if the name still refers to the ring created by 'open'
+  int fd = shm_open(this->name.c_str(), O_RDONLY, 0);
+  if (fd < 0)
+    return;
+
+  struct stat st;
+  if (fstat(fd, &st) == 0 and (uint64_t)st.st_dev == this->dev and
+      (uint64_t)st.st_ino == this->ino)
+    shm_unlink(this->name.c_str());
+  ::close(fd);
+}
+
+bool FramePublisher::ensure_shape(const std::vector<int> &shape)
+{
+  if (!this->p_header)
+    return false;
+
+  if (this->p_header->ni == shape[0] and this->p_header->nj == shape[1])
+    return true;
+
+  std::string name = this->name;
+  return this->open(name, shape, this->nslots);
+}
+
+float *FramePublisher::begin_write(FrameSlotHeader *&p_slot,
+                                   uint64_t         &seq,
+                                   float             t,
+                                   uint64_t          params_hash)
+{
+  const uint64_t n = this->p_header->nframes.load(std::memory_order_relaxed);
+
+  p_slot = get_slot(this->p_header, (int)(n % this->p_header->nslots));
+  seq = p_slot->seq.load(std::memory_order_relaxed);
+
+  p_slot->seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  p_slot->frame_index = n;
+  p_slot->params_hash = params_hash;
+  p_slot->t = t;
+
+  return get_data(p_slot);
+}
+
+void FramePublisher::end_write(FrameSlotHeader *p_slot, uint64_t seq)
+{
+  p_slot->seq.store(seq + 2, std::memory_order_release);
+  this->p_header->nframes.fetch_add(1, std::memory_order_release);
+}
+
+bool FramePublisher::publish(const Array &dz, float t, uint64_t params_hash)
+{
+  if (!this->ensure_shape(dz.shape))
+    return false;
+
+  FrameSlotHeader *p_slot;
+  uint64_t         seq;
+  float           *p_data = this->begin_write(p_slot, seq, t, params_hash);
+
+  std::memcpy(p_data, dz.data(), dz.size() * sizeof(float));
+
+  this->end_write(p_slot, seq);
+  return true;
+}
+
+bool FramePublisher::publish(GerstnerWave &wave, float t, uint64_t params_hash)
+{
+  if (!this->ensure_shape(wave.shape))
+    return false;
+
+  FrameSlotHeader *p_slot;
+  uint64_t         seq;
+  float           *p_data = this->begin_write(p_slot, seq, t, params_hash);
+
+  wave.generate(t, p_data, wave.shape[1] * sizeof(float), sizeof(float));
+
+  this->end_write(p_slot, seq);
+  return true;
+}
+
+// --- subscriber
+
+FrameSubscriber::~FrameSubscriber()
+{
+  this->close();
+}
+
+bool FrameSubscriber::open(std::string name)
+{
+  this->close();
+
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 or (size_t)st.st_size < FRAME_RING_HEADER_SIZE)
+  {
+    ::close(fd);
+    return false;
+  }
+
+  const size_t size = (size_t)st.st_size;
+  void        *p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+
+  if (p == MAP_FAILED)
+    return false;
+
+  const FrameRingHeader *p_header = (const FrameRingHeader *)p;
+  const bool             valid =
+      p_header->magic == FRAME_RING_MAGIC and
+      p_header->version == FRAME_RING_VERSION and
+      size >= FRAME_RING_HEADER_SIZE + p_header->nslots * p_header->slot_size;
+  std::atomic_thread_fence(std::memory_order_acquire);
+
+  if (!valid)
+  {
+    munmap(p, size);
+    return false;
+  }
+
+  this->size = size;
+  this->p_header = p_header;
+  return true;
+}
+
+void FrameSubscriber::close()
+{
+  if (!this->p_header)
+    return;
+
+  munmap((void *)this->p_header, this->size);
+  this->p_header = nullptr;
+}
+
+bool FrameSubscriber::is_stale() const
+{
+  return !this->p_header or
+         this->p_header->closed.load(std::memory_order_acquire) != 0;
+}
+
+bool FrameSubscriber::acquire(FrameView &view) const
+{
+  if (!this->p_header)
+    return false;
+
+  for (int retry = 0; retry < READ_MAX_RETRIES; retry++)
+  {
+    const uint64_t n = this->p_header->nframes.load(std::memory_order_acquire);
+    if (n == 0)
+      return false;
+
+    const FrameSlotHeader *p_slot =
+        get_slot(this->p_header, (int)((n - 1) % this->p_header->nslots));
+    const uint64_t seq = p_slot->seq.load(std::memory_order_acquire);
+
+    if (seq & 1) // being overwritten, the reader is lagging
+      continue;
+
+    view.p_data = get_data(p_slot);
+    view.ni = this->p_header->ni;
+    view.nj = this->p_header->nj;
+    view.frame_index = p_slot->frame_index;
+    view.params_hash = p_slot->params_hash;
+    view.t = p_slot->t;
+    view.p_slot = p_slot;
+    view.seq = seq;
+
+    if (this->validate(view))
+      return true;
+  }
+
+  return false;
+}
+
+bool FrameSubscriber::validate(const FrameView &view) const
+{
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return view.p_slot and
+         view.p_slot->seq.load(std::memory_order_relaxed) == view.seq;
+}
+
+bool FrameSubscriber::read(std::vector<float> &data, FrameView &view) const
+{
+  for (int retry = 0; retry < READ_MAX_RETRIES; retry++)
+  {
+    if (!this->acquire(view))
+      return false;
+
+    data.resize((size_t)view.ni * view.nj);
+    std::memcpy(data.data(), view.p_data, data.size() * sizeof(float));
+
+    if (this->validate(view))
+      return true;
+  }
+
+  return false;
+}
@@ -1,160 +1,1060 @@
 // Copyright (c) 2023 Otto Link. Distributed under the terms of the
 // GNU General Public License. The full license is in the file
 // LICENSE, distributed with this software.
+#include <limits>
+
 #include "core/gerstner.hpp"
 #include "core/array.hpp"
 #include "core/fbm.hpp"
+#include "core/hash.hpp"
+#include "core/resampling.hpp"
+#include "core/spectral.hpp"
+#include "core/task_graph.hpp"
 
 void GerstnerWave::update()
 {
+  TaskGraph graph;
+  this->add_update_tasks(graph);
+  graph.run();
+}
+
+void GerstnerWave::add_update_tasks(TaskGraph       &graph,
+                                    std::vector<int> depth_tasks)
+{
+  // the shape is known before the water depth is computed
   this->shape = p_h->shape;
   this->r = this->steepness / this->kinf; // wave height
   this->omega = this->kinf * this->phase_speed;
 
   this->dz.set_shape(this->shape);
 
-  // --- main grid
+  // the intermediate fields are valid once the update is complete
+  const uint64_t key = this->get_region_key();
+  this->region_key = 0;
+
+  // grid -----------------------.
+  // depth --> shore distance ---+--> active cells
+  //       `-> phase lag
+  int t_grid = graph.add_task([this]() { this->update_grid(); });
+
+  int t_shore = graph.add_task(
+      [this]()
+      {
+        if (!this->cancelled())
+          this->update_shore_distance();
+      },
+      depth_tasks);
+
+  int t_phase = graph.add_task(
+      [this]()
+      {
+        if (this->cancelled())
+          return;
+        if (this->periodic)
+          this->update_phase_lag_periodic();
+        else
+          this->update_phase_lag();
+      },
+      depth_tasks);
+
+  int t_cells = graph.add_task(
+      [this]()
+      {
+        if (!this->cancelled())
+          this->update_active_cells();
+      },
+      {t_grid, t_shore});
+
+  graph.add_task(
+      [this, key]()
+      {
+        if (!this->cancelled())
+          this->region_key = key;
+      },
+      {t_phase, t_cells});
+}
+
+void GerstnerWave::update_from_fields()
+{
+  this->shape = p_h->shape;
+  this->r = this->steepness / this->kinf; // wave height
+  this->omega = this->kinf * this->phase_speed;
+
+  this->dz.set_shape(this->shape);
+
+  this->update_grid();
+  this->update_active_cells();
+
+  // the intermediate fields are not restored
+  this->region_key = 0;
+}
+
+void GerstnerWave::update_region_fields()
+{
+  this->shape = p_h->shape;
+  this->region_key = 0;
+
+  // same stages as 'update', without their products
+  this->dt = distance_transform(*this->p_h, this->dt_g, this->periodic);
+  if (this->cancelled())
+    return;
+
+  if (this->periodic)
+    this->update_phase_lag_lines();
+  else
+    this->update_phase_lag_rotated();
+
+  if (!this->cancelled())
+    this->region_key = this->get_region_key();
+}
+
+void GerstnerWave::swap_region_fields(GerstnerWave &other)
+{
+  std::swap(this->region_key, other.region_key);
+  std::swap(this->dt, other.dt);
+  std::swap(this->dt_g, other.dt_g);
+  std::swap(this->fk, other.fk);
+  std::swap(this->phi_depth_r, other.phi_depth_r);
+  std::swap(this->phi_lines, other.phi_lines);
+  std::swap(this->phi_drift, other.phi_drift);
+}
+
+void GerstnerWave::update_region(int i1, int i2, int j1, int j2)
+{
+  i1 = std::max(0, i1);
+  i2 = std::min(this->shape[0], i2);
+  j1 = std::max(0, j1);
+  j2 = std::min(this->shape[1], j2);
+
+  if (i1 >= i2 or j1 >= j2)
+    return;
+
+  if (this->region_key == 0 or this->region_key != this->get_region_key())
+  {
+    this->update();
+    return;
+  }
+
+  // rows to be rescanned for the active cells, the modified rows and the
+  // rows with cells changing type
+  std::vector<char> rows(this->shape[0], 0);
+  std::fill(rows.begin() + i1, rows.begin() + i2, 1);
+
+  TaskGraph graph;
+
+  int t_shore = graph.add_task(
+      [this, i1, i2, &rows]()
+      { this->update_shore_distance_region(i1, i2, rows); });
+
+  graph.add_task(
+      [this, i1, i2, j1, j2]()
+      {
+        if (this->periodic)
+          this->update_phase_lag_periodic_region(i1, i2, j1, j2);
+        else
+          this->update_phase_lag_region(i1, i2, j1, j2);
+      });
+
+  graph.add_task([this, &rows]() { this->update_active_cells_rows(rows); },
+                 {t_shore});
+
+  graph.run();
+}
+
+uint64_t GerstnerWave::get_region_key() const
+{
+  return fnv1a(this->shape.data(),
+               this->shape.size() * sizeof(int),
+               parameters_hash(*this));
+}
+
+void update_pipeline(WaterDepth &depth, GerstnerWave &wave)
+{
+  TaskGraph graph;
+  int       t_depth = graph.add_task([&depth]() { depth.update(); });
+  wave.add_update_tasks(graph, {t_depth});
+  graph.run();
+}
+
+void GerstnerWave::update_grid()
+{
+  // in periodic mode the last node is the first node of the next tile
+  const float ni = (float)(this->periodic ? this->shape[0] : this->shape[0] - 1);
+  const float nj = (float)(this->periodic ? this->shape[1] : this->shape[1] - 1);
 
   this->x0.set_shape(this->shape);
   this->y0.set_shape(this->shape);
 
+#pragma omp parallel for schedule(static)
   for (int i = 0; i < this->shape[0]; i++)
   {
-    float x = M_PI * (2.f * (float)i / (float)(this->shape[0] - 1) - 1.f);
+    float  x = M_PI * (2.f * (float)i / ni - 1.f);
+    float *p_x0 = &this->x0(i, 0);
+    float *p_y0 = &this->y0(i, 0);
+
     for (int j = 0; j < this->shape[1]; j++)
     {
-      float y = M_PI * (2.f * (float)j / (float)(this->shape[1] - 1) - 1.f);
-      this->x0(i, j) = x;
-      this->y0(i, j) = y;
+      p_x0[j] = x;
+      p_y0[j] = M_PI * (2.f * (float)j / nj - 1.f);
     }
   }
+}
 
-  // --- distance to the shore
+static inline float shore_decay_coefficient(const GerstnerWave &wave)
+{
+  return 0.5f / std::pow((float)wave.shape[0] / wave.kinf *
+                             wave.shore_dist_ratio,
+                         2.f);
+}
 
+void GerstnerWave::update_shore_distance()
+{
+  // squared distance
+  this->dt = distance_transform(*this->p_h, this->dt_g, this->periodic);
   this->shore_dist.set_shape(this->shape);
-  this->shore_dist = distance_transform(*this->p_h); // squared distance
+  refresh_thread_share();
+
+  float c_decay = shore_decay_coefficient(*this);
 
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < this->shape[0]; i++)
   {
-    float c_decay = 0.5f / std::pow((float)this->shape[0] / this->kinf *
-                                        this->shore_dist_ratio,
-                                    2.f);
+    const float *p_dt = &this->dt(i, 0);
+    float       *p_row = &this->shore_dist(i, 0);
 
-    for (int i = 0; i < this->shape[0]; i++)
-      for (int j = 0; j < this->shape[1]; j++)
-        this->shore_dist(i, j) =
-            1.f - std::exp(-this->shore_dist(i, j) * c_decay);
+    for (int j = 0; j < this->shape[1]; j++)
+      p_row[j] = 1.f - std::exp(-p_dt[j] * c_decay);
   }
+}
 
-  // --- accumulative phase lag due to depth variations
-
-  this->phi_depth.set_shape(this->shape);
+void GerstnerWave::update_shore_distance_region(int                i1,
+                                                int                i2,
+                                                std::vector<char> &rows)
+{
+  const int ni = this->shape[0];
+  int       j1, j2;
 
-  // create rotated larger grid
-  Array xr = Array(this->shape);
-  Array yr = Array(this->shape);
-  float ca = std::cos(this->alpha);
-  float sa = std::sin(this->alpha);
+  distance_transform_update_rows(*this->p_h,
+                                 this->dt_g,
+                                 i1,
+                                 i2,
+                                 this->periodic,
+                                 j1,
+                                 j2);
 
-  float scale = M_PI * M_SQRT2;
+  const float c_decay = shore_decay_coefficient(*this);
+  const float threshold = 1.f - this->open_water_eps;
 
-  for (int i = 0; i < this->shape[0]; i++)
+#pragma omp parallel
   {
-    float x = scale * (2.f * (float)i / (float)(this->shape[0] - 1) - 1.f);
-    for (int j = 0; j < this->shape[1]; j++)
+    std::vector<char> rows_changed(ni, 0);
+
+#pragma omp for schedule(dynamic, 4)
+    for (int j = j1; j < j2; j++)
     {
-      float y = scale * (2.f * (float)j / (float)(this->shape[1] - 1) - 1.f);
-      xr(i, j) = x * ca - y * sa;
-      yr(i, j) = x * sa + y * ca;
+      int u1, u2;
+      distance_transform_update_column(this->dt_g,
+                                       this->dt,
+                                       j,
+                                       i1,
+                                       i2,
+                                       this->periodic,
+                                       u1,
+                                       u2);
+
+      for (int u = u1; u < u2; u++)
+      {
+        int    i = u < 0 ? u + ni : u % ni;
+        float &sd = this->shore_dist(i, j);
+        float  sd_new = 1.f - std::exp(-this->dt(i, j) * c_decay);
+
+        if ((sd < threshold) != (sd_new < threshold))
+          rows_changed[i] = 1;
+        sd = sd_new;
+      }
     }
+
+#pragma omp critical
+    for (int i = 0; i < ni; i++)
+      rows[i] |= rows_changed[i];
+  }
+}
+
+static std::vector<CellSpan> rect_spans(int i1, int i2, int j1, int j2)
+{
+  std::vector<CellSpan> spans;
+  for (int i = i1; i < i2; i++)
+    spans.push_back({i, j1, j2});
+  return spans;
+}
+
+// wavenumber excess from the water depth 'h' on the cells covered by
+// 'spans' ('h' and 'fk' can be the same array)
+static void wavenumber_excess(const GerstnerWave          &wave,
+                              const Array                 &h,
+                              Array                       &fk,
+                              const std::vector<CellSpan> &spans)
+{
+#pragma omp parallel for schedule(static)
+  for (size_t s = 0; s < spans.size(); s++)
+  {
+    const float *p_h = &h(spans[s].i, 0);
+    float       *p_fk = &fk(spans[s].i, 0);
+
+    for (int j = spans[s].j1; j < spans[s].j2; j++)
+      p_fk[j] = wavenumber_excess(p_h[j], wave.kinf, wave.k_clipping_ratio);
   }
+}
+
+// main grid and larger grid aligned with the wave direction, on which
+// the phase lag is integrated
+struct RotatedGrids
+{
+  Grid   grid;
+  Grid   grid_r;
+  Affine rotation;     // rotated grid to main grid
+  Affine rotation_inv; // main grid to rotated grid
+  float  dxr;          // integration step
+};
+
+static RotatedGrids rotated_grids(const GerstnerWave &wave)
+{
+  float ca = std::cos(wave.alpha);
+  float sa = std::sin(wave.alpha);
+
+  float scale = M_PI * M_SQRT2;
+
+  return {{wave.shape, -M_PI, M_PI, -M_PI, M_PI},
+          {wave.shape, -scale, scale, -scale, scale},
+          {ca, -sa, sa, ca, 0.f, 0.f},
+          {ca, sa, -sa, ca, 0.f, 0.f},
+          2.f * scale / (float)(wave.shape[0] - 1) * ca};
+}
+
+// accumulative phase lag along the columns [j1, j2) of the rotated
+// grid, from row 'i1' (the previous rows are left unchanged)
+static void integrate_phase_lag(const Array &fk,
+                                Array       &phi_depth_r,
+                                float        dxr,
+                                int          i1,
+                                int          j1,
+                                int          j2)
+{
+#pragma omp parallel for schedule(static)
+  for (int j = j1; j < j2; j++)
+  {
+    if (i1 == 0)
+      phi_depth_r(0, j) = dxr * fk(0, j);
+
+    for (int i = std::max(1, i1); i < fk.shape[0]; i++)
+      phi_depth_r(i, j) = phi_depth_r(i - 1, j) + dxr * fk(i, j);
+  }
+}
+
+// nodes of the 'target' grid whose image by 'transform' lies in the
+// range [u1, u2] x [v1, v2] of (fractional, possibly infinite) indices
+// of the 'source' grid, with a margin of one node
+static std::vector<CellSpan> mapped_spans(const Grid   &target,
+                                          const Affine &transform,
+                                          const Grid   &source,
+                                          float         u1,
+                                          float         u2,
+                                          float         v1,
+                                          float         v2)
+{
+  const float inf = std::numeric_limits<float>::infinity();
+  const int   ni = target.shape[0];
+  const int   nj = target.shape[1];
+  const float dx = (target.xmax - target.xmin) / (float)(ni - 1);
+  const float dy = (target.ymax - target.ymin) / (float)(nj - 1);
+  const float sx = (source.xmax - source.xmin) / (float)(source.shape[0] - 1);
+  const float sy = (source.ymax - source.ymin) / (float)(source.shape[1] - 1);
+
+  const float cmin[2] = {source.xmin + sx * u1, source.ymin + sy * v1};
+  const float cmax[2] = {source.xmin + sx * u2, source.ymin + sy * v2};
+  const float slope[2] = {transform.a01, transform.a11};
+
+  std::vector<CellSpan> spans;
+
+  for (int i = 0; i < ni; i++)
+  {
+    // on a row, both image coordinates are linear in 'y'
+    float x = target.xmin + dx * (float)i;
+    float c0[2] = {transform.a00 * x + transform.b0,
+                   transform.a10 * x + transform.b1};
+    float ylo = -inf;
+    float yhi = inf;
+
+    for (int c = 0; c < 2; c++)
+      if (std::abs(slope[c]) < 1e-6f)
+      {
+        if (c0[c] < cmin[c] or c0[c] > cmax[c])
+          ylo = inf;
+      }
+      else
+      {
+        float ya = (cmin[c] - c0[c]) / slope[c];
+        float yb = (cmax[c] - c0[c]) / slope[c];
+        ylo = std::max(ylo, std::min(ya, yb));
+        yhi = std::min(yhi, std::max(ya, yb));
+      }
+
+    float jlo = std::max(0.f, std::floor((ylo - target.ymin) / dy) - 1.f);
+    float jhi = std::min((float)nj, std::ceil((yhi - target.ymin) / dy) + 2.f);
+
+    if (jlo < jhi)
+      spans.push_back({i, (int)jlo, (int)jhi});
+  }
+
+  return spans;
+}
+
+void GerstnerWave::update_phase_lag()
+{
+  // accumulative phase lag due to depth variations
+  this->phi_depth.set_shape(this->shape);
+  this->update_phase_lag_rotated();
+
+  // interpolate back on initial mesh
+  const RotatedGrids rg = rotated_grids(*this);
+
+  refresh_thread_share();
+  get_resampling_plan(rg.grid_r,
+                      rg.grid,
+                      rg.rotation_inv,
+                      RESAMPLING_BILINEAR)
+      ->apply(this->phi_depth_r, this->phi_depth);
+}
+
+void GerstnerWave::update_phase_lag_rotated()
+{
+  this->fk.set_shape(this->shape);
+  this->phi_depth_r.set_shape(this->shape);
+
+  // rotated larger grid, the resampling plans between the main grid
+  // and the rotated grid only depend on the shape and the wave angle
+  // and are cached (bilinear, the nearest node leaves steps of up to
+  // one rotated cell in the integrated phase lag)
+  const RotatedGrids rg = rotated_grids(*this);
 
   // interpolate water depth on rotated grid
-  Array hr = interp_nearest(this->x0, this->y0, *p_h, xr, yr);
+  get_resampling_plan(rg.grid, rg.grid_r, rg.rotation, RESAMPLING_BILINEAR)
+      ->apply(*p_h, this->fk);
 
   // compute accumulative phase lag
-  Array fk = Array(this->shape);
+  refresh_thread_share();
+  wavenumber_excess(*this,
+                    this->fk,
+                    this->fk,
+                    rect_spans(0, this->shape[0], 0, this->shape[1]));
 
-  for (int i = 0; i < this->shape[0]; i++)
-    for (int j = 0; j < this->shape[1]; j++)
+  refresh_thread_share();
+  integrate_phase_lag(this->fk,
+                      this->phi_depth_r,
+                      rg.dxr,
+                      0,
+                      0,
+                      this->shape[1]);
+}
+
+void GerstnerWave::update_phase_lag_region(int i1, int i2, int j1, int j2)
+{
+  const float        inf = std::numeric_limits<float>::infinity();
+  const int          ni = this->shape[0];
+  const int          nj = this->shape[1];
+  const RotatedGrids rg = rotated_grids(*this);
+
+  // rotated nodes sampling the modified cells (the nodes outside the
+  // main grid sample its borders)
+  std::vector<CellSpan> spans_r = mapped_spans(
+      rg.grid_r,
+      rg.rotation,
+      rg.grid,
+      i1 == 0 ? -inf : (float)(i1 - 1),
+      i2 == ni ? inf : (float)(i2 + 1),
+      j1 == 0 ? -inf : (float)(j1 - 1),
+      j2 == nj ? inf : (float)(j2 + 1));
+
+  if (spans_r.empty())
+    return;
+
+  get_resampling_plan(rg.grid, rg.grid_r, rg.rotation, RESAMPLING_BILINEAR)
+      ->apply(*p_h, this->fk, spans_r);
+  wavenumber_excess(*this, this->fk, this->fk, spans_r);
+
+  // the phase lag only changes downstream, on the columns of these nodes
+  int ri1 = spans_r.front().i;
+  int rj1 = nj;
+  int rj2 = 0;
+
+  for (auto &span : spans_r)
+  {
+    rj1 = std::min(rj1, span.j1);
+    rj2 = std::max(rj2, span.j2);
+  }
+
+  integrate_phase_lag(this->fk, this->phi_depth_r, rg.dxr, ri1, rj1, rj2);
+
+  // main nodes sampling the updated part of the rotated grid
+  std::vector<CellSpan> spans = mapped_spans(
+      rg.grid,
+      rg.rotation_inv,
+      rg.grid_r,
+      ri1 == 0 ? -inf : (float)(ri1 - 1),
+      inf,
+      rj1 == 0 ? -inf : (float)(rj1 - 1),
+      rj2 == nj ? inf : (float)(rj2 + 1));
+
+  get_resampling_plan(rg.grid_r,
+                      rg.grid,
+                      rg.rotation_inv,
+                      RESAMPLING_BILINEAR)
+      ->apply(this->phi_depth_r, this->phi_depth, spans);
+}
+
+// Sheared lines along which the phase lag is integrated in periodic
+// mode, marching along the dominant axis 'a' of the wave direction and
+// wrapping around the domain. The lines are closed after one period by
+// snapping the total shear to an integer number of cells.
+struct PeriodicLines
+{
+  int   n1; // steps per line
+  int   n2; // number of lines
+  int   nj;
+  bool  march_i;
+  bool  reverse;
+  float shear; // cells along 'b' per step along 'a'
+  float ds;    // path length per step
+
+  // (a, b) to flat index
+  int index(int a, int b) const
+  {
+    int p = this->reverse ? this->n1 - 1 - a : a;
+    return this->march_i ? p * this->nj + b : b * this->nj + p;
+  }
+};
+
+static PeriodicLines periodic_lines(const GerstnerWave &wave)
+{
+  float kx, ky;
+  wave.wave_vector(kx, ky);
+
+  const float dx = 2.f * M_PI / (float)wave.shape[0];
+  const float dy = 2.f * M_PI / (float)wave.shape[1];
+
+  // direction in cell units
+  float kn = std::max(1e-6f, std::hypot(kx, ky));
+  float di = kx / kn / dx;
+  float dj = ky / kn / dy;
+
+  PeriodicLines pl;
+  pl.march_i = std::abs(di) >= std::abs(dj);
+  pl.n1 = pl.march_i ? wave.shape[0] : wave.shape[1];
+  pl.n2 = pl.march_i ? wave.shape[1] : wave.shape[0];
+  pl.nj = wave.shape[1];
+  pl.reverse = pl.march_i ? di < 0.f : dj < 0.f;
+
+  pl.shear = pl.march_i ? dj / std::abs(di) : di / std::abs(dj);
+  pl.shear = std::round(pl.shear * (float)pl.n1) / (float)pl.n1;
+  pl.ds = 1.f / std::max(std::abs(di), std::abs(dj));
+
+  return pl;
+}
+
+// integration along a line (a single code path for the full and the
+// incremental updates, for bitwise identical results)
+static void integrate_line(const PeriodicLines &pl,
+                           const float         *fk,
+                           int                  line,
+                           float               *p_phi,
+                           float               &drift)
+{
+  float sum = 0.f;
+
+  for (int a = 0; a < pl.n1; a++)
+  {
+    float b = (float)line + pl.shear * (float)a;
+    float bf = std::floor(b);
+    float w = b - bf;
+    int   b1 = ((int)bf % pl.n2 + pl.n2) % pl.n2;
+    int   b2 = (b1 + 1) % pl.n2;
+
+    sum += pl.ds * ((1.f - w) * fk[pl.index(a, b1)] + w * fk[pl.index(a, b2)]);
+    p_phi[a] = sum;
+  }
+
+  // drift removal, phase back to zero after a full period
+  drift = sum / (float)pl.n1;
+
+  for (int a = 0; a < pl.n1; a++)
+    p_phi[a] -= drift * (float)(a + 1);
+}
+
+// phase lag of cell (a, b) from the lines (line-major storage)
+static inline float gather_lines(const PeriodicLines      &pl,
+                                 const std::vector<float> &phi_lines,
+                                 int                       a,
+                                 int                       b)
+{
+  float line = (float)b - pl.shear * (float)a;
+  float lf = std::floor(line);
+  float w = line - lf;
+  int   l1 = ((int)lf % pl.n2 + pl.n2) % pl.n2;
+  int   l2 = (l1 + 1) % pl.n2;
+
+  return (1.f - w) * phi_lines[l1 * pl.n1 + a] + w * phi_lines[l2 * pl.n1 + a];
+}
+
+void GerstnerWave::update_phase_lag_periodic()
+{
+  // The phase lag is integrated along the periodic lines, the drift of
+  // the phase along each line is removed so that the phase is
+  // continuous across the tile boundaries.
+  this->phi_depth.set_shape(this->shape);
+  this->update_phase_lag_lines();
+
+  // gather on the main grid
+  const PeriodicLines pl = periodic_lines(*this);
+
+  refresh_thread_share();
+
+  float *p_phi = this->phi_depth.data();
+
+#pragma omp parallel for schedule(static)
+  for (int a = 0; a < pl.n1; a++)
+    for (int b = 0; b < pl.n2; b++)
+      p_phi[pl.index(a, b)] = gather_lines(pl, this->phi_lines, a, b);
+}
+
+void GerstnerWave::update_phase_lag_lines()
+{
+  const PeriodicLines pl = periodic_lines(*this);
+
+  this->fk.set_shape(this->shape);
+  wavenumber_excess(*this,
+                    *this->p_h,
+                    this->fk,
+                    rect_spans(0, this->shape[0], 0, this->shape[1]));
+
+  this->phi_lines.resize(pl.n1 * pl.n2);
+  this->phi_drift.resize(pl.n2);
+  refresh_thread_share();
+
+#pragma omp parallel for schedule(static)
+  for (int line = 0; line < pl.n2; line++)
+    integrate_line(pl,
+                   this->fk.data(),
+                   line,
+                   this->phi_lines.data() + line * pl.n1,
+                   this->phi_drift[line]);
+}
+
+void GerstnerWave::update_phase_lag_periodic_region(int i1,
+                                                    int i2,
+                                                    int j1,
+                                                    int j2)
+{
+  const PeriodicLines pl = periodic_lines(*this);
+
+  // modified cells in line coordinates
+  const int p1 = pl.march_i ? i1 : j1;
+  const int p2 = pl.march_i ? i2 : j2;
+  const int b1 = pl.march_i ? j1 : i1;
+  const int b2 = pl.march_i ? j2 : i2;
+  const int a1 = pl.reverse ? pl.n1 - p2 : p1;
+  const int a2 = pl.reverse ? pl.n1 - p1 : p2;
+
+  // lines sampling these cells ('line + shear * a' in [b - 1, b + 1)),
+  // with a margin of one line. The whole line changes because of the
+  // drift removal
+  const float s1 = std::min(pl.shear * (float)a1, pl.shear * (float)(a2 - 1));
+  const float s2 = std::max(pl.shear * (float)a1, pl.shear * (float)(a2 - 1));
+  const int   l1 = (int)std::floor((float)b1 - 1.f - s2) - 1;
+  const int   l2 = (int)std::ceil((float)b2 - s1) + 1;
+  const int   nlines = std::min(pl.n2, l2 - l1 + 1);
+
+  wavenumber_excess(*this, *this->p_h, this->fk, rect_spans(i1, i2, j1, j2));
+
+#pragma omp parallel for schedule(static)
+  for (int k = 0; k < nlines; k++)
+  {
+    int line = ((l1 + k) % pl.n2 + pl.n2) % pl.n2;
+    integrate_line(pl,
+                   this->fk.data(),
+                   line,
+                   this->phi_lines.data() + line * pl.n1,
+                   this->phi_drift[line]);
+  }
+
+  // cells gathering from these lines ('b - shear * a' in [l1 - 1, l2 +
+  // 1]), with a margin of one cell
+  const int nb = std::min(pl.n2, l2 - l1 + 5);
+
+  float *p_phi = this->phi_depth.data();
+
+#pragma omp parallel for schedule(static)
+  for (int a = 0; a < pl.n1; a++)
+  {
+    int bs = (int)std::floor((float)(l1 - 2) + pl.shear * (float)a);
+
+    for (int k = 0; k < nb; k++)
     {
-      float v = std::min(this->k_clipping_ratio,
-                         1.f / std::sqrt(std::tanh(-this->kinf * hr(i, j))));
-      fk(i, j) = v - 1.f;
-      fk(i, j) *= this->kinf;
+      int b = ((bs + k) % pl.n2 + pl.n2) % pl.n2;
+      p_phi[pl.index(a, b)] = gather_lines(pl, this->phi_lines, a, b);
     }
+  }
+}
 
-  Array phi_depth_r = Array(this->shape);
-  float dxr = xr(1, 0) - xr(0, 0);
+void GerstnerWave::wave_vector(float &kx, float &ky) const
+{
+  kx = this->kinf * std::cos(this->alpha);
+  ky = this->kinf * std::sin(this->alpha);
 
-  for (int j = 0; j < this->shape[1]; j++)
+  // the wave needs to be periodic on the [-pi, pi[ tile
+  if (this->periodic)
   {
-    phi_depth_r(0, j) = dxr * fk(0, j);
-    for (int i = 1; i < this->shape[0]; i++)
-      phi_depth_r(i, j) = phi_depth_r(i - 1, j) + dxr * fk(i, j);
+    kx = std::round(kx);
+    ky = std::round(ky);
   }
+}
 
-  // interpolate back on initial mesh
+float GerstnerWave::phase_drift(float u, float v) const
+{
+  if (!this->periodic or this->phi_drift.empty())
+    return 0.f;
+
+  const PeriodicLines pl = periodic_lines(*this);
+
+  // line through (u, v), between the two nearest lines
+  float p = pl.march_i ? u : v;
+  float a = pl.reverse ? (float)(pl.n1 - 1) - p : p;
+  float line = (pl.march_i ? v : u) - pl.shear * a;
+  float lf = std::floor(line);
+  float w = line - lf;
+  int   l1 = ((int)lf % pl.n2 + pl.n2) % pl.n2;
+  int   l2 = (l1 + 1) % pl.n2;
+
+  return ((1.f - w) * this->phi_drift[l1] + w * this->phi_drift[l2]) / pl.ds;
+}
+
+void GerstnerWave::append_row_spans(int                    i,
+                                    std::vector<CellSpan> &land,
+                                    std::vector<CellSpan> &shore,
+                                    std::vector<CellSpan> &open) const
+{
+  const Array &h = *this->p_h;
+  const float  threshold = 1.f - this->open_water_eps;
+
+  int j = 0;
+  while (j < this->shape[1])
   {
-    Array x0r = Array(this->shape);
-    Array y0r = Array(this->shape);
+    // 0: land, 1: shore band, 2: open water
+    int type = 0;
+    int j1 = j;
 
-    // trick to have a regular grid
-    for (int i = 0; i < this->shape[0]; i++)
+    do
     {
-      float x = M_PI * (2.f * (float)i / (float)(this->shape[0] - 1) - 1.f);
-      for (int j = 0; j < this->shape[1]; j++)
-      {
-        float y = M_PI * (2.f * (float)j / (float)(this->shape[1] - 1) - 1.f);
-        xr(i, j) = M_SQRT2 * x;
-        yr(i, j) = M_SQRT2 * y;
-        x0r(i, j) = x * ca + y * sa;
-        y0r(i, j) = -x * sa + y * ca;
-      }
-    }
+      int t = h(i, j) >= 0.f                         ? 0
+              : this->shore_dist(i, j) < threshold ? 1
+                                                   : 2;
+      if (j == j1)
+        type = t;
+      else if (t != type)
+        break;
+      j++;
+    } while (j < this->shape[1]);
 
-    phi_depth = interp_nearest(xr, yr, phi_depth_r, x0r, y0r);
+    if (type == 0)
+      land.push_back({i, j1, j});
+    else if (type == 1)
+      shore.push_back({i, j1, j});
+    else if (type == 2)
+      open.push_back({i, j1, j});
   }
 }
 
-void GerstnerWave::generate(float t)
+void GerstnerWave::update_active_cells()
+{
+  this->spans_land.clear();
+  this->spans_shore.clear();
+  this->spans_open.clear();
+
+  for (int i = 0; i < this->shape[0]; i++)
+    this->append_row_spans(i,
+                           this->spans_land,
+                           this->spans_shore,
+                           this->spans_open);
+
+  // land cells are left untouched by 'generate'
+  this->x_disp = this->x0;
+  this->y_disp = this->y0;
+  this->dz_disp.set_shape(this->shape);
+  std::fill(this->dz_disp.data(),
+            this->dz_disp.data() + this->dz_disp.size(),
+            0.f);
+}
+
+// replaces the spans of the flagged rows, spans are sorted by row
+static void merge_spans(std::vector<CellSpan>       &spans,
+                        const std::vector<CellSpan> &row_spans,
+                        const std::vector<char>     &rows)
 {
-  Array x = Array(this->shape);
-  Array y = Array(this->shape);
+  std::vector<CellSpan> merged;
+  merged.reserve(spans.size() + row_spans.size());
 
-  float ca = std::cos(this->alpha);
-  float sa = std::sin(this->alpha);
+  size_t k = 0;
+  for (auto &span : spans)
+  {
+    if (rows[span.i])
+      continue;
+    while (k < row_spans.size() and row_spans[k].i < span.i)
+      merged.push_back(row_spans[k++]);
+    merged.push_back(span);
+  }
+  merged.insert(merged.end(), row_spans.begin() + k, row_spans.end());
+
+  spans.swap(merged);
+}
+
+void GerstnerWave::update_active_cells_rows(const std::vector<char> &rows)
+{
+  std::vector<CellSpan> land, shore, open;
 
   for (int i = 0; i < this->shape[0]; i++)
-    for (int j = 0; j < this->shape[1]; j++)
+    if (rows[i])
+      this->append_row_spans(i, land, shore, open);
+
+  merge_spans(this->spans_land, land, rows);
+  merge_spans(this->spans_shore, shore, rows);
+  merge_spans(this->spans_open, open, rows);
+
+  // land cells are left untouched by 'generate'
+  for (auto &span : land)
+    for (int j = span.j1; j < span.j2; j++)
     {
-      float phi = this->kinf * ca * x0(i, j) + this->kinf * sa * y0(i, j) -
-                  this->omega * t + this->phi_depth(i, j) + this->phi0;
+      this->x_disp(span.i, j) = this->x0(span.i, j);
+      this->y_disp(span.i, j) = this->y0(span.i, j);
+      this->dz_disp(span.i, j) = 0.f;
+    }
+}
+
+// bilinear interpolation on the main grid, zero outside the domain
+static inline float interp_bilinear(const Array &array,
+                                    float        x,
+                                    float        y,
+                                    float        ax,
+                                    float        ay)
+{
+  float u = ax * (x + M_PI);
+  float v = ay * (y + M_PI);
+
+  if (u < 0.f || v < 0.f || u > (float)(array.shape[0] - 1) ||
+      v > (float)(array.shape[1] - 1))
+    return 0.f;
+
+  int   p = std::min(array.shape[0] - 2, (int)u);
+  int   q = std::min(array.shape[1] - 2, (int)v);
+  float tu = u - (float)p;
+  float tv = v - (float)q;
 
-      float rloc =
-          this->r * (1.f - this->shore_r_ratio * this->shore_dist(i, j));
-      rloc *= std::pow(this->shore_dist(i, j), 0.2f);
+  return (1.f - tu) * ((1.f - tv) * array(p, q) + tv * array(p, q + 1)) +
+         tu * ((1.f - tv) * array(p + 1, q) + tv * array(p + 1, q + 1));
+}
+
+// bilinear interpolation on the main grid, periodic domain
+static inline float interp_bilinear_periodic(const Array &array,
+                                             float        x,
+                                             float        y,
+                                             float        ax,
+                                             float        ay)
+{
+  const int ni = array.shape[0];
+  const int nj = array.shape[1];
 
-      x(i, j) = x0(i, j) - rloc * std::sin(phi) * ca;
-      y(i, j) = y0(i, j) - rloc * std::sin(phi) * sa;
-      dz(i, j) = -rloc * std::cos(phi);
+  float u = ax * (x + M_PI);
+  float v = ay * (y + M_PI);
+  float uf = std::floor(u);
+  float vf = std::floor(v);
+  float tu = u - uf;
+  float tv = v - vf;
+
+  int p = ((int)uf % ni + ni) % ni;
+  int q = ((int)vf % nj + nj) % nj;
+  int p1 = p + 1 < ni ? p + 1 : 0;
+  int q1 = q + 1 < nj ? q + 1 : 0;
+
+  return (1.f - tu) * ((1.f - tv) * array(p, q) + tv * array(p, q1)) +
+         tu * ((1.f - tv) * array(p1, q) + tv * array(p1, q1));
+}
+
+void GerstnerWave::generate(float t)
+{
+  this->generate(t,
+                 this->dz.data(),
+                 this->shape[1] * sizeof(float),
+                 sizeof(float));
+}
+
+void GerstnerWave::generate(float     t,
+                            float    *p_out,
+                            ptrdiff_t stride_i,
+                            ptrdiff_t stride_j)
+{
+  this->displace(t);
+  this->resample(p_out, stride_i, stride_j);
+
+  if (this->p_spectral)
+    this->add_spectral(t, p_out, stride_i, stride_j);
+}
+
+void GerstnerWave::displace(float t)
+{
+  const float ca = std::cos(this->alpha);
+  const float sa = std::sin(this->alpha);
+  float       kx, ky;
+  this->wave_vector(kx, ky);
+  const float phase = -this->omega * t + this->phi0;
+
+  // input fields, read-only
+  const Array &x0 = this->x0;
+  const Array &y0 = this->y0;
+  const Array &phi_depth = this->phi_depth;
+  const Array &shore_dist = this->shore_dist;
+
+  // --- shore band, full model
+
+#pragma omp parallel for schedule(dynamic, 16)
+  for (size_t s = 0; s < this->spans_shore.size(); s++)
+  {
+    const CellSpan span = this->spans_shore[s];
+    const int      i = span.i;
+
+    const float *p_x0 = &x0(i, 0);
+    const float *p_y0 = &y0(i, 0);
+    const float *p_phi = &phi_depth(i, 0);
+    const float *p_sd = &shore_dist(i, 0);
+    float       *p_xd = &this->x_disp(i, 0);
+    float       *p_yd = &this->y_disp(i, 0);
+    float       *p_zd = &this->dz_disp(i, 0);
+
+    for (int j = span.j1; j < span.j2; j++)
+    {
+      float phi = kx * p_x0[j] + ky * p_y0[j] + phase + p_phi[j];
+
+      float rloc = this->r * (1.f - this->shore_r_ratio * p_sd[j]);
+      rloc *= std::pow(p_sd[j], 0.2f);
+
+      float sp = std::sin(phi);
+      p_xd[j] = p_x0[j] - rloc * sp * ca;
+      p_yd[j] = p_y0[j] - rloc * sp * sa;
+      float dz0 = -rloc * std::cos(phi);
 
       // kuldgeing
-      float ck = (1.f - this->shore_dist(i, j)) * this->kludge;
-      dz(i, j) = -rloc * std::cos(phi - ck * dz(i, j));
+      float ck = (1.f - p_sd[j]) * this->kludge;
+      p_zd[j] = -rloc * std::cos(phi - ck * dz0);
     }
+  }
+
+  // --- open water, shore distance is saturated (analytic Gerstner
+  // --- wave with the deep water amplitude)
+
+  const float rdeep = this->r * (1.f - this->shore_r_ratio);
 
+#pragma omp parallel for schedule(dynamic, 16)
+  for (size_t s = 0; s < this->spans_open.size(); s++)
   {
-    _2D::BilinearInterpolator<float> interp;
-    interp.setData(this->x0.vector, this->y0.vector, dz.vector);
+    const CellSpan span = this->spans_open[s];
+    const int      i = span.i;
 
-    for (int i = 0; i < this->shape[0]; i++)
-      for (int j = 0; j < this->shape[1]; j++)
-      {
-        if ((*this->p_h)(i, j) < 0.f)
-          this->dz(i, j) = interp(x(i, j), y(i, j));
-        else
-          this->dz(i, j) = 0.f;
-      }
+    const float *p_x0 = &x0(i, 0);
+    const float *p_y0 = &y0(i, 0);
+    const float *p_phi = &phi_depth(i, 0);
+    float       *p_xd = &this->x_disp(i, 0);
+    float       *p_yd = &this->y_disp(i, 0);
+    float       *p_zd = &this->dz_disp(i, 0);
+
+#pragma omp simd
+    for (int j = span.j1; j < span.j2; j++)
+    {
+      float phi = kx * p_x0[j] + ky * p_y0[j] + phase + p_phi[j];
+      float sp = std::sin(phi);
+      p_xd[j] = p_x0[j] - rdeep * sp * ca;
+      p_yd[j] = p_y0[j] - rdeep * sp * sa;
+      p_zd[j] = -rdeep * std::cos(phi);
+    }
+  }
+}
+
+void GerstnerWave::resample(float *p_out, ptrdiff_t stride_i, ptrdiff_t stride_j)
+{
+  // --- resample elevation at the displaced positions (water only)
+  // --- and store the output
+
+  const int   ni = this->periodic ? this->shape[0] : this->shape[0] - 1;
+  const int   nj = this->periodic ? this->shape[1] : this->shape[1] - 1;
+  const float ax = (float)ni / (2.f * M_PI);
+  const float ay = (float)nj / (2.f * M_PI);
+  char       *p_base = (char *)p_out;
+
+  const Array &x_disp = this->x_disp;
+  const Array &y_disp = this->y_disp;
+  const Array &dz_disp = this->dz_disp;
+
+  for (int pass = 0; pass < 3; pass++)
+  {
+    const std::vector<CellSpan> &spans = pass == 0   ? this->spans_land
+                                         : pass == 1 ? this->spans_shore
+                                                     : this->spans_open;
+
+#pragma omp parallel for schedule(dynamic, 16)
+    for (size_t s = 0; s < spans.size(); s++)
+    {
+      const int    i = spans[s].i;
+      char        *p_row = p_base + i * stride_i;
+      const float *p_xd = &x_disp(i, 0);
+      const float *p_yd = &y_disp(i, 0);
+
+      for (int j = spans[s].j1; j < spans[s].j2; j++)
+        *(float *)(p_row + j * stride_j) =
+            pass == 0 ? 0.f
+            : this->periodic
+                ? interp_bilinear_periodic(dz_disp, p_xd[j], p_yd[j], ax, ay)
+                : interp_bilinear(dz_disp, p_xd[j], p_yd[j], ax, ay);
+    }
+  }
+}
+
+void GerstnerWave::add_spectral(float     t,
+                                float    *p_out,
+                                ptrdiff_t stride_i,
+                                ptrdiff_t stride_j)
+{
+  this->p_spectral->synthesize(t);
+
+  const SpectralOcean &so = *this->p_spectral;
+  const Array         &x0 = this->x0;
+  const Array         &y0 = this->y0;
+  const Array         &shore_dist = this->shore_dist;
+  char                *p_base = (char *)p_out;
+
+  for (int pass = 0; pass < 2; pass++)
+  {
+    const std::vector<CellSpan> &spans = pass == 0 ? this->spans_shore
+                                                   : this->spans_open;
+
+#pragma omp parallel for schedule(dynamic, 16)
+    for (size_t s = 0; s < spans.size(); s++)
+    {
+      const int    i = spans[s].i;
+      char        *p_row = p_base + i * stride_i;
+      const float *p_x0 = &x0(i, 0);
+      const float *p_y0 = &y0(i, 0);
+      const float *p_sd = &shore_dist(i, 0);
+
+      for (int j = spans[s].j1; j < spans[s].j2; j++)
+        *(float *)(p_row + j * stride_j) += p_sd[j] *
+                                            so.sample(p_x0[j], p_y0[j]);
+    }
   }
 }
 
@@ -166,16 +1066,127 @@ void WaterDepth::update()
                        this->octaves,
                        this->weight,
                        this->persistence,
-                       this->lacunarity);
+                       this->lacunarity,
+                       {0.f, 0.f},
+                       this->periodic);
 
   for (int i = 0; i < this->h.shape[0]; i++)
   {
     float dh =
-        slope * (float)(i - 0.5f * this->h.shape[0]) / float(this->h.shape[0]);
+        this->periodic
+            ? 0.f
+            : slope * (float)(i - 0.5f * this->h.shape[0]) /
+                  float(this->h.shape[0]);
+    float *p_row = &this->h(i, 0);
+
     for (int j = 0; j < this->h.shape[1]; j++)
+      p_row[j] = (p_row[j] + dh + this->offset) * this->scaling;
+  }
+
+  this->edits = 0;
+}
+
+void WaterDepth::apply_brush(float ic,
+                             float jc,
+                             float radius,
+                             float amount,
+                             int  &i1,
+                             int  &i2,
+                             int  &j1,
+                             int  &j2)
+{
+  i1 = std::max(0, (int)std::floor(ic - radius));
+  i2 = std::min(this->shape[0], (int)std::ceil(ic + radius) + 1);
+  j1 = std::max(0, (int)std::floor(jc - radius));
+  j2 = std::min(this->shape[1], (int)std::ceil(jc + radius) + 1);
+
+  if (i1 >= i2 or j1 >= j2 or radius <= 0.f)
+  {
+    i2 = i1;
+    j2 = j1;
+    return;
+  }
+
+  for (int i = i1; i < i2; i++)
+  {
+    float *p_row = &this->h(i, 0);
+
+    for (int j = j1; j < j2; j++)
     {
-      this->h(i, j) += dh + this->offset;
-      this->h(i, j) *= this->scaling;
+      float r2 = ((float)i - ic) * ((float)i - ic) +
+                 ((float)j - jc) * ((float)j - jc);
+      float s = std::max(0.f, 1.f - r2 / (radius * radius));
+      p_row[j] += amount * s * s;
     }
   }
+
+  this->edits++;
+}
+
+void copy_parameters(const WaterDepth &from, WaterDepth &to)
+{
+  to.kw = from.kw;
+  to.seed = from.seed;
+  to.octaves = from.octaves;
+  to.weight = from.weight;
+  to.persistence = from.persistence;
+  to.lacunarity = from.lacunarity;
+  to.slope = from.slope;
+  to.offset = from.offset;
+  to.scaling = from.scaling;
+  to.periodic = from.periodic;
+  to.edits = from.edits;
+}
+
+void copy_parameters(const GerstnerWave &from, GerstnerWave &to)
+{
+  to.kinf = from.kinf;
+  to.alpha = from.alpha;
+  to.steepness = from.steepness;
+  to.phi0 = from.phi0;
+  to.phase_speed = from.phase_speed;
+  to.kludge = from.kludge;
+  to.k_clipping_ratio = from.k_clipping_ratio;
+  to.shore_dist_ratio = from.shore_dist_ratio;
+  to.shore_r_ratio = from.shore_r_ratio;
+  to.open_water_eps = from.open_water_eps;
+  to.periodic = from.periodic;
+}
+
+uint64_t parameters_hash(const WaterDepth &depth, uint64_t hash)
+{
+  hash = fnv1a(depth.shape.data(), depth.shape.size() * sizeof(int), hash);
+  hash = fnv1a(depth.kw.data(), depth.kw.size() * sizeof(float), hash);
+  hash = fnv1a(depth.seed, hash);
+  hash = fnv1a(depth.octaves, hash);
+  hash = fnv1a(depth.weight, hash);
+  hash = fnv1a(depth.persistence, hash);
+  hash = fnv1a(depth.lacunarity, hash);
+  hash = fnv1a(depth.slope, hash);
+  hash = fnv1a(depth.offset, hash);
+  hash = fnv1a(depth.scaling, hash);
+  hash = fnv1a(depth.periodic, hash);
+  hash = fnv1a(depth.edits, hash);
+  return hash;
+}
+
+uint64_t parameters_hash(const GerstnerWave &wave, uint64_t hash)
+{
+  hash = fnv1a(wave.kinf, hash);
+  hash = fnv1a(wave.alpha, hash);
+  hash = fnv1a(wave.steepness, hash);
+  hash = fnv1a(wave.phi0, hash);
+  hash = fnv1a(wave.phase_speed, hash);
+  hash = fnv1a(wave.kludge, hash);
+  hash = fnv1a(wave.k_clipping_ratio, hash);
+  hash = fnv1a(wave.shore_dist_ratio, hash);
+  hash = fnv1a(wave.shore_r_ratio, hash);
+  hash = fnv1a(wave.open_water_eps, hash);
+  hash = fnv1a(wave.periodic, hash);
+  return hash;
+}
+
+uint64_t parameters_hash(const WaterDepth &depth, const GerstnerWave &wave)
+{
+  return parameters_hash(wave, parameters_hash(depth));
 }
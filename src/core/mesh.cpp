@@ -0,0 +1,113 @@
+// Copyright (c) 2023 Otto Link. Distributed under the terms of the
+// GNU General Public License. The full license is in the file
+// LICENSE, distributed with this software.
+#include <algorithm>
+
+#include "core/mesh.hpp"
+#include "core/spectral.hpp"
+
+// subsampled indices, last node always included
+static std::vector<int> lod_indices(int n, int step)
+{
+  std::vector<int> idx;
+  for (int k = 0; k < n - 1; k += step)
+    idx.push_back(k);
+  idx.push_back(n - 1);
+  return idx;
+}
+
+SurfaceMesh::SurfaceMesh(std::vector<int> shape, int lod_step, float skirt_depth)
+    : shape(shape), lod_step(std::max(1, lod_step)), skirt_depth(skirt_depth)
+{
+  this->rows = lod_indices(this->shape[0], this->lod_step);
+  this->cols = lod_indices(this->shape[1], this->lod_step);
+
+  const uint32_t na = (uint32_t)this->rows.size();
+  const uint32_t nb = (uint32_t)this->cols.size();
+
+  // grid
+  this->indices.reserve(6 * (na - 1) * (nb - 1));
+
+  for (uint32_t a = 0; a < na - 1; a++)
+    for (uint32_t b = 0; b < nb - 1; b++)
+    {
+      uint32_t v00 = a * nb + b;
+      uint32_t v10 = v00 + nb;
+
+      this->indices.insert(this->indices.end(),
+                           {v00, v10, v00 + 1, v00 + 1, v10, v10 + 1});
+    }
+
+  // skirts, one extra vertex below each border vertex
+  if (this->skirt_depth > 0.f)
+  {
+    for (uint32_t b = 0; b < nb - 1; b++)
+      this->ring.push_back(b);
+    for (uint32_t a = 0; a < na - 1; a++)
+      this->ring.push_back(a * nb + nb - 1);
+    for (uint32_t b = nb - 1; b > 0; b--)
+      this->ring.push_back((na - 1) * nb + b);
+    for (uint32_t a = na - 1; a > 0; a--)
+      this->ring.push_back(a * nb);
+
+    const uint32_t nr = (uint32_t)this->ring.size();
+    const uint32_t s0 = na * nb;
+
+    for (uint32_t k = 0; k < nr; k++)
+    {
+      uint32_t k1 = (k + 1) % nr;
+      uint32_t v0 = this->ring[k];
+      uint32_t v1 = this->ring[k1];
+
+      this->indices.insert(this->indices.end(),
+                           {v0, v1, s0 + k, v1, s0 + k1, s0 + k});
+    }
+  }
+}
+
+void SurfaceMesh::write_vertices(GerstnerWave &wave,
+                                 float         t,
+                                 float        *p_vertices,
+                                 ptrdiff_t     stride)
+{
+  wave.displace(t);
+
+  // deep water detail at the displaced positions (the weight is zero on
+  // land)
+  const SpectralOcean *p_spectral = wave.p_spectral;
+  if (p_spectral)
+    wave.p_spectral->synthesize(t);
+
+  const int na = (int)this->rows.size();
+  const int nb = (int)this->cols.size();
+  char     *p_base = (char *)p_vertices;
+
+#pragma omp parallel for schedule(static)
+  for (int a = 0; a < na; a++)
+    for (int b = 0; b < nb; b++)
+    {
+      int    i = this->rows[a];
+      int    j = this->cols[b];
+      float *p = (float *)(p_base + (a * nb + b) * stride);
+
+      p[0] = wave.x_disp(i, j);
+      p[1] = wave.y_disp(i, j);
+      p[2] = wave.dz_disp(i, j);
+
+      if (p_spectral)
+        p[2] += wave.shore_dist(i, j) * p_spectral->sample(p[0], p[1]);
+    }
+
+  // skirts
+  const size_t s0 = (size_t)na * nb;
+
+  for (size_t k = 0; k < this->ring.size(); k++)
+  {
+    const float *p_src = (const float *)(p_base + this->ring[k] * stride);
+    float       *p = (float *)(p_base + (s0 + k) * stride);
+
+    p[0] = p_src[0];
+    p[1] = p_src[1];
+    p[2] = p_src[2] - this->skirt_depth;
+  }
+}
@@ -0,0 +1,182 @@
+// Copyright (c) 2023 Otto Link. Distributed under the terms of the
+// GNU General Public License. The full license is in the file
+// LICENSE, distributed with this software.
+#include <algorithm>
+#include <utility>
+
+#include "core/progressive.hpp"
+
+ProgressiveUpdate::ProgressiveUpdate(WaterDepth &depth, GerstnerWave &wave)
+    : depth(depth), wave(wave), coarse_depth(depth), coarse_wave(wave),
+      fine_depth(depth), fine_wave(wave), cancel(false), done(false)
+{
+  this->coarse_wave.p_h = &this->coarse_depth.h;
+  this->fine_wave.p_h = &this->fine_depth.h;
+  this->fine_wave.p_cancel = &this->cancel;
+}
+
+ProgressiveUpdate::~ProgressiveUpdate()
+{
+  this->cancel = true;
+  if (this->worker.joinable())
+    this->worker.join();
+}
+
+void ProgressiveUpdate::request(bool depth_changed)
+{
+  if (this->running)
+    this->cancel = true;
+
+  this->pending = true;
+  this->last_request = std::chrono::steady_clock::now();
+
+  // coarse preview
+  std::vector<int> shape = {
+      std::max(2, this->depth.shape[0] / this->coarsening),
+      std::max(2, this->depth.shape[1] / this->coarsening)};
+
+  this->depth_outdated |= depth_changed;
+
+  if (depth_changed or this->coarse_depth.shape != shape)
+  {
+    copy_parameters(this->depth, this->coarse_depth);
+    this->coarse_depth.set_shape(shape);
+    copy_parameters(this->wave, this->coarse_wave);
+    update_pipeline(this->coarse_depth, this->coarse_wave);
+  }
+  else
+  {
+    copy_parameters(this->wave, this->coarse_wave);
+    this->coarse_wave.update();
+  }
+  this->preview = true;
+}
+
+bool ProgressiveUpdate::poll(bool interacting)
+{
+  if (this->running and this->done)
+    return this->collect();
+
+  if (!this->running and this->pending and !interacting)
+  {
+    std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() -
+                                           this->last_request;
+    if (elapsed.count() > this->idle_delay)
+      this->start_refinement();
+  }
+
+  // fields restored from the cache
+  if (!this->running and !this->pending and !this->preview and
+      this->wave.region_key == 0)
+    this->start_preparation();
+
+  return false;
+}
+
+void ProgressiveUpdate::finish()
+{
+  // discard a cancelled refinement
+  if (this->running and this->cancel)
+    this->collect();
+
+  if (!this->running and this->pending)
+    this->start_refinement();
+
+  if (this->running)
+    this->collect();
+}
+
+void ProgressiveUpdate::start_refinement()
+{
+  this->cancel = false;
+  this->done = false;
+  this->running = true;
+  this->pending = false;
+  this->preparing = false;
+
+  bool update_depth = this->depth_outdated;
+  this->refining_depth = update_depth;
+  this->depth_outdated = false;
+
+  copy_parameters(this->depth, this->fine_depth);
+  copy_parameters(this->wave, this->fine_wave);
+
+  if (update_depth)
+    this->fine_depth.set_shape(this->depth.shape);
+  else
+    this->fine_depth.h = this->depth.h;
+
+  this->worker = std::thread(
+      [this, update_depth]()
+      {
+        if (this->p_cache)
+          cached_update(*this->p_cache,
+                        this->fine_depth,
+                        this->fine_wave,
+                        update_depth);
+        else if (update_depth)
+          update_pipeline(this->fine_depth, this->fine_wave);
+        else
+          this->fine_wave.update();
+        this->done = true;
+      });
+}
+
+void ProgressiveUpdate::start_preparation()
+{
+  this->cancel = false;
+  this->done = false;
+  this->running = true;
+  this->preparing = true;
+
+  // on a copy, the displayed fields are not modified
+  copy_parameters(this->depth, this->fine_depth);
+  copy_parameters(this->wave, this->fine_wave);
+  this->fine_depth.h = this->depth.h;
+
+  this->worker = std::thread(
+      [this]()
+      {
+        this->fine_wave.update_region_fields();
+        this->done = true;
+      });
+}
+
+bool ProgressiveUpdate::collect()
+{
+  if (this->worker.joinable())
+    this->worker.join();
+  this->running = false;
+
+  if (this->cancel)
+  {
+    // results discarded
+    if (!this->preparing)
+      this->depth_outdated |= this->refining_depth;
+    return false;
+  }
+
+  if (this->preparing)
+  {
+    if (this->fine_wave.region_key == this->wave.get_region_key())
+      this->wave.swap_region_fields(this->fine_wave);
+    return false;
+  }
+
+  // the computed fields are exchanged, the settings of the displayed
+  // wave are kept
+  SpectralOcean *p_spectral = this->wave.p_spectral;
+
+  std::swap(this->depth, this->fine_depth);
+  std::swap(this->wave, this->fine_wave);
+
+  this->wave.p_h = &this->depth.h;
+  this->wave.p_cancel = nullptr;
+  this->wave.p_spectral = p_spectral;
+  this->fine_wave.p_h = &this->fine_depth.h;
+  this->fine_wave.p_cancel = &this->cancel;
+  this->fine_wave.p_spectral = nullptr;
+
+  this->preview = false;
+  return true;
+}
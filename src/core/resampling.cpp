@@ -0,0 +1,204 @@
+// Copyright (c) 2023 Otto Link. Distributed under the terms of the
+// GNU General Public License. The full license is in the file
+// LICENSE, distributed with this software.
+#include <cmath>
+#include <list>
+#include <mutex>
+#include <utility>
+
+#include "core/resampling.hpp"
+
+ResamplingPlan::ResamplingPlan(const Grid   &source,
+                               const Grid   &target,
+                               const Affine &transform,
+                               int           method)
+    : shape(target.shape), method(method)
+{
+  const int ni = source.shape[0];
+  const int nj = source.shape[1];
+  const int nc = method == RESAMPLING_BILINEAR ? 4 : 1;
+
+  // source coordinates to (fractional) source indices
+  float ax = (ni - 1) / (source.xmax - source.xmin);
+  float ay = (nj - 1) / (source.ymax - source.ymin);
+  float bx = -source.xmin * (ni - 1) / (source.xmax - source.xmin);
+  float by = -source.ymin * (nj - 1) / (source.ymax - source.ymin);
+
+  float dx = (target.xmax - target.xmin) / (float)(this->shape[0] - 1);
+  float dy = (target.ymax - target.ymin) / (float)(this->shape[1] - 1);
+
+  this->index.resize(nc * this->shape[0] * this->shape[1]);
+  if (method == RESAMPLING_BILINEAR)
+    this->weight.resize(this->index.size());
+
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < this->shape[0]; i++)
+  {
+    float x = target.xmin + dx * (float)i;
+    for (int j = 0; j < this->shape[1]; j++)
+    {
+      float y = target.ymin + dy * (float)j;
+      float xt = transform.a00 * x + transform.a01 * y + transform.b0;
+      float yt = transform.a10 * x + transform.a11 * y + transform.b1;
+      int   k = i * this->shape[1] + j;
+
+      if (method == RESAMPLING_NEAREST)
+      {
+        int p = (int)(ax * xt + bx);
+        int q = (int)(ay * yt + by);
+
+        p = std::min(ni - 1, std::max(0, p));
+        q = std::min(nj - 1, std::max(0, q));
+        this->index[k] = p * nj + q;
+      }
+      else
+      {
+        float u = std::min((float)(ni - 1), std::max(0.f, ax * xt + bx));
+        float v = std::min((float)(nj - 1), std::max(0.f, ay * yt + by));
+        int   p = std::min(ni - 2, (int)u);
+        int   q = std::min(nj - 2, (int)v);
+        float tu = u - (float)p;
+        float tv = v - (float)q;
+
+        this->index[4 * k] = p * nj + q;
+        this->index[4 * k + 1] = (p + 1) * nj + q;
+        this->index[4 * k + 2] = p * nj + q + 1;
+        this->index[4 * k + 3] = (p + 1) * nj + q + 1;
+        this->weight[4 * k] = (1.f - tu) * (1.f - tv);
+        this->weight[4 * k + 1] = tu * (1.f - tv);
+        this->weight[4 * k + 2] = (1.f - tu) * tv;
+        this->weight[4 * k + 3] = tu * tv;
+      }
+    }
+  }
+}
+
+Array ResamplingPlan::apply(const Array &array) const
+{
+  Array out = Array(this->shape);
+  this->apply(array, out);
+  return out;
+}
+
+void ResamplingPlan::apply(const Array &array, Array &out) const
+{
+  const int    n = this->shape[0] * this->shape[1];
+  const int   *p_idx = this->index.data();
+  const float *p_in = array.data();
+  float       *p_out = out.data();
+
+  if (this->method == RESAMPLING_NEAREST)
+  {
+#pragma omp parallel for schedule(static)
+    for (int k = 0; k < n; k++)
+      p_out[k] = p_in[p_idx[k]];
+  }
+  else
+  {
+    const float *p_w = this->weight.data();
+
+#pragma omp parallel for schedule(static)
+    for (int k = 0; k < n; k++)
+      p_out[k] = p_w[4 * k] * p_in[p_idx[4 * k]] +
+                 p_w[4 * k + 1] * p_in[p_idx[4 * k + 1]] +
+                 p_w[4 * k + 2] * p_in[p_idx[4 * k + 2]] +
+                 p_w[4 * k + 3] * p_in[p_idx[4 * k + 3]];
+  }
+}
+
+void ResamplingPlan::apply(const Array                 &array,
+                           Array                       &out,
+                           const std::vector<CellSpan> &spans) const
+{
+  const int    nj = this->shape[1];
+  const int   *p_idx = this->index.data();
+  const float *p_in = array.data();
+  float       *p_out = out.data();
+
+#pragma omp parallel for schedule(dynamic, 16)
+  for (size_t s = 0; s < spans.size(); s++)
+  {
+    const int k1 = spans[s].i * nj + spans[s].j1;
+    const int k2 = spans[s].i * nj + spans[s].j2;
+
+    if (this->method == RESAMPLING_NEAREST)
+      for (int k = k1; k < k2; k++)
+        p_out[k] = p_in[p_idx[k]];
+    else
+    {
+      const float *p_w = this->weight.data();
+
+      for (int k = k1; k < k2; k++)
+        p_out[k] = p_w[4 * k] * p_in[p_idx[4 * k]] +
+                   p_w[4 * k + 1] * p_in[p_idx[4 * k + 1]] +
+                   p_w[4 * k + 2] * p_in[p_idx[4 * k + 2]] +
+                   p_w[4 * k + 3] * p_in[p_idx[4 * k + 3]];
+    }
+  }
+}
+
+// --- plan cache
+
+static std::vector<float> plan_key(const Grid   &source,
+                                   const Grid   &target,
+                                   const Affine &transform,
+                                   int           method)
+{
+  return {(float)method,
+          (float)source.shape[0],
+          (float)source.shape[1],
+          source.xmin,
+          source.xmax,
+          source.ymin,
+          source.ymax,
+          (float)target.shape[0],
+          (float)target.shape[1],
+          target.xmin,
+          target.xmax,
+          target.ymin,
+          target.ymax,
+          transform.a00,
+          transform.a01,
+          transform.a10,
+          transform.a11,
+          transform.b0,
+          transform.b1};
+}
+
+std::shared_ptr<const ResamplingPlan> get_resampling_plan(
+    const Grid   &source,
+    const Grid   &target,
+    const Affine &transform,
+    int           method)
+{
+  typedef std::pair<std::vector<float>, std::shared_ptr<const ResamplingPlan>>
+      Entry;
+
+  static std::list<Entry> cache; // most recently used first
+  static std::mutex       cache_mutex;
+
+  std::vector<float> key = plan_key(source, target, transform, method);
+
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    for (std::list<Entry>::iterator it = cache.begin(); it != cache.end();
+         ++it)
+      if (it->first == key)
+      {
+        cache.splice(cache.begin(), cache, it);
+        return cache.front().second;
+      }
+  }
+
+  std::shared_ptr<const ResamplingPlan> plan =
+      std::make_shared<const ResamplingPlan>(source, target, transform, method);
+
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    cache.push_front(Entry(key, plan));
+    if (cache.size() > RESAMPLING_CACHE_SIZE)
+      cache.pop_back();
+  }
+
+  return plan;
+}
@@ -0,0 +1,310 @@
+// Copyright (c) 2023 Otto Link. Distributed under the terms of the
+// GNU General Public License. The full license is in the file
+// LICENSE, distributed with this software.
+#include <new>
+
+#include "shorewaves.h"
+
+#include "core/mesh.hpp"
+#include "core/shorewaves.hpp"
+
+// nothing is computed before the parameters or the depth data are set,
+// the first 'update' generates the water depth
+ShoreWaves::ShoreWaves(std::vector<int> shape)
+    : depth(shape, false), wave(depth.h, false)
+{
+}
+
+sw_depth_params ShoreWaves::get_depth_params() const
+{
+  sw_depth_params params;
+  params.kw[0] = this->depth.kw[0];
+  params.kw[1] = this->depth.kw[1];
+  params.seed = this->depth.seed;
+  params.octaves = this->depth.octaves;
+  params.weight = this->depth.weight;
+  params.persistence = this->depth.persistence;
+  params.lacunarity = this->depth.lacunarity;
+  params.slope = this->depth.slope;
+  params.offset = this->depth.offset;
+  params.scaling = this->depth.scaling;
+  params.periodic = this->depth.periodic ? 1 : 0;
+  return params;
+}
+
+void ShoreWaves::set_depth_params(const sw_depth_params &params)
+{
+  this->depth.kw = {params.kw[0], params.kw[1]};
+  this->depth.seed = params.seed;
+  this->depth.octaves = params.octaves;
+  this->depth.weight = params.weight;
+  this->depth.persistence = params.persistence;
+  this->depth.lacunarity = params.lacunarity;
+  this->depth.slope = params.slope;
+  this->depth.offset = params.offset;
+  this->depth.scaling = params.scaling;
+  this->depth.periodic = params.periodic != 0;
+
+  this->depth_imported = false;
+  this->depth_outdated = true;
+}
+
+void ShoreWaves::set_depth_data(const float *p_h,
+                                ptrdiff_t    stride_i,
+                                ptrdiff_t    stride_j)
+{
+  const char *p_base = (const char *)p_h;
+
+  for (int i = 0; i < this->depth.shape[0]; i++)
+  {
+    float *p_row = &this->depth.h(i, 0);
+
+    for (int j = 0; j < this->depth.shape[1]; j++)
+      p_row[j] = *(const float *)(p_base + i * stride_i + j * stride_j);
+  }
+
+  this->depth_imported = true;
+  this->depth_outdated = false;
+}
+
+sw_wave_params ShoreWaves::get_wave_params() const
+{
+  sw_wave_params params;
+  params.kinf = this->wave.kinf;
+  params.alpha = this->wave.alpha;
+  params.steepness = this->wave.steepness;
+  params.phi0 = this->wave.phi0;
+  params.phase_speed = this->wave.phase_speed;
+  params.kludge = this->wave.kludge;
+  params.k_clipping_ratio = this->wave.k_clipping_ratio;
+  params.shore_dist_ratio = this->wave.shore_dist_ratio;
+  params.shore_r_ratio = this->wave.shore_r_ratio;
+  params.periodic = this->wave.periodic ? 1 : 0;
+  return params;
+}
+
+void ShoreWaves::set_wave_params(const sw_wave_params &params)
+{
+  this->wave.kinf = params.kinf;
+  this->wave.alpha = params.alpha;
+  this->wave.steepness = params.steepness;
+  this->wave.phi0 = params.phi0;
+  this->wave.phase_speed = params.phase_speed;
+  this->wave.kludge = params.kludge;
+  this->wave.k_clipping_ratio = params.k_clipping_ratio;
+  this->wave.shore_dist_ratio = params.shore_dist_ratio;
+  this->wave.shore_r_ratio = params.shore_r_ratio;
+  this->wave.periodic = params.periodic != 0;
+}
+
+void ShoreWaves::update()
+{
+  this->updated = false;
+  cached_update(this->cache,
+                this->depth,
+                this->wave,
+                this->depth_outdated,
+                this->depth_imported);
+  this->depth_outdated = false;
+  this->updated = true;
+}
+
+void ShoreWaves::generate(float     t,
+                          float    *p_out,
+                          ptrdiff_t stride_i,
+                          ptrdiff_t stride_j)
+{
+  if (!this->updated)
+    this->update();
+  this->wave.generate(t, p_out, stride_i, stride_j);
+}
+
+// --- C interface
+
+// no exception crosses the C interface, they are turned into error codes
+template <typename F> static int guarded(F f)
+{
+  try
+  {
+    f();
+  }
+  catch (const std::bad_alloc &)
+  {
+    return SW_ERROR_OUT_OF_MEMORY;
+  }
+  catch (...)
+  {
+    return SW_ERROR_INTERNAL;
+  }
+  return SW_OK;
+}
+
+struct sw_model
+{
+  ShoreWaves model;
+
+  sw_model(int ni, int nj) : model({ni, nj})
+  {
+  }
+};
+
+sw_model *sw_create(int ni, int nj)
+{
+  if (ni < 2 or nj < 2)
+    return nullptr;
+
+  // the fields are allocated by the constructor
+  try
+  {
+    return new sw_model(ni, nj);
+  }
+  catch (...)
+  {
+    return nullptr;
+  }
+}
+
+void sw_destroy(sw_model *p_model)
+{
+  delete p_model;
+}
+
+void sw_get_depth_params(const sw_model *p_model, sw_depth_params *p_params)
+{
+  if (p_model and p_params)
+    *p_params = p_model->model.get_depth_params();
+}
+
+int sw_set_depth_params(sw_model *p_model, const sw_depth_params *p_params)
+{
+  if (!p_model or !p_params)
+    return SW_ERROR_INVALID_ARGUMENT;
+  return guarded([&]() { p_model->model.set_depth_params(*p_params); });
+}
+
+int sw_set_depth_data(sw_model    *p_model,
+                      const float *p_h,
+                      ptrdiff_t    stride_i,
+                      ptrdiff_t    stride_j)
+{
+  if (!p_model or !p_h)
+    return SW_ERROR_INVALID_ARGUMENT;
+  return guarded([&]()
+                 { p_model->model.set_depth_data(p_h, stride_i, stride_j); });
+}
+
+void sw_get_wave_params(const sw_model *p_model, sw_wave_params *p_params)
+{
+  if (p_model and p_params)
+    *p_params = p_model->model.get_wave_params();
+}
+
+int sw_set_wave_params(sw_model *p_model, const sw_wave_params *p_params)
+{
+  if (!p_model or !p_params or p_params->kinf <= 0.f)
+    return SW_ERROR_INVALID_ARGUMENT;
+  return guarded([&]() { p_model->model.set_wave_params(*p_params); });
+}
+
+int sw_set_cache_dir(sw_model *p_model, const char *dir)
+{
+  if (!p_model)
+    return SW_ERROR_INVALID_ARGUMENT;
+
+  return guarded(
+      [&]()
+      {
+        if (!dir)
+          p_model->model.set_cache_dir("");
+        else
+          p_model->model.set_cache_dir(dir[0] ? std::string(dir)
+                                              : default_cache_dir());
+      });
+}
+
+int sw_update(sw_model *p_model)
+{
+  if (!p_model)
+    return SW_ERROR_INVALID_ARGUMENT;
+  return guarded([&]() { p_model->model.update(); });
+}
+
+int sw_generate(sw_model *p_model,
+                float     t,
+                float    *p_out,
+                ptrdiff_t stride_i,
+                ptrdiff_t stride_j)
+{
+  if (!p_model or !p_out)
+    return SW_ERROR_INVALID_ARGUMENT;
+  return guarded([&]()
+                 { p_model->model.generate(t, p_out, stride_i, stride_j); });
+}
+
+struct sw_mesh
+{
+  SurfaceMesh mesh;
+
+  sw_mesh(std::vector<int> shape, int lod_step, float skirt_depth)
+      : mesh(shape, lod_step, skirt_depth)
+  {
+  }
+};
+
+sw_mesh *sw_mesh_create(const sw_model *p_model,
+                        int             lod_step,
+                        float           skirt_depth)
+{
+  if (!p_model)
+    return nullptr;
+
+  try
+  {
+    return new sw_mesh(p_model->model.get_shape(), lod_step, skirt_depth);
+  }
+  catch (...)
+  {
+    return nullptr;
+  }
+}
+
+void sw_mesh_destroy(sw_mesh *p_mesh)
+{
+  delete p_mesh;
+}
+
+size_t sw_mesh_get_vertex_count(const sw_mesh *p_mesh)
+{
+  return p_mesh ? p_mesh->mesh.get_nvertices() : 0;
+}
+
+size_t sw_mesh_get_index_count(const sw_mesh *p_mesh)
+{
+  return p_mesh ? p_mesh->mesh.indices.size() : 0;
+}
+
+const uint32_t *sw_mesh_get_indices(const sw_mesh *p_mesh)
+{
+  return p_mesh ? p_mesh->mesh.indices.data() : nullptr;
+}
+
+int sw_mesh_write_vertices(sw_mesh  *p_mesh,
+                           sw_model *p_model,
+                           float     t,
+                           float    *p_vertices,
+                           ptrdiff_t stride)
+{
+  if (!p_mesh or !p_model or !p_vertices or
+      p_mesh->mesh.shape != p_model->model.get_shape())
+    return SW_ERROR_INVALID_ARGUMENT;
+  return guarded(
+      [&]()
+      {
+        if (!p_model->model.is_updated())
+          p_model->model.update();
+        p_mesh->mesh.write_vertices(p_model->model.wave,
+                                    t,
+                                    p_vertices,
+                                    stride);
+      });
+}
@@ -0,0 +1,143 @@
+// Copyright (c) 2023 Otto Link. Distributed under the terms of the
+// GNU General Public License. The full license is in the file
+// LICENSE, distributed with this software.
+#include <random>
+
+#include "core/fft.hpp"
+#include "core/spectral.hpp"
+
+// frequency of the FFT index 'p' for a size 'n'
+static inline int frequency(int p, int n)
+{
+  return p < n / 2 ? p : p - n;
+}
+
+void SpectralOcean::update()
+{
+  // powers of two for the FFT
+  for (auto &n : this->shape)
+  {
+    int m = 2;
+    while (m < n)
+      m *= 2;
+    n = m;
+  }
+
+  const int   ni = this->shape[0];
+  const int   nj = this->shape[1];
+  const float dk = (float)this->repeat; // tile fundamental wavenumber
+  const float ca = std::cos(this->alpha);
+  const float sa = std::sin(this->alpha);
+
+  // the Phillips spectrum exp(-1 / (k L)^2) / k^4 peaks at 1 / (L sqrt(2))
+  const float lw = 1.f / (M_SQRT2 * this->k_peak);
+
+  std::vector<float> spectrum_p(ni * nj, 0.f);
+  double             sum = 0.0;
+
+  this->omega.assign(ni * nj, 0.f);
+
+  for (int p = 0; p < ni; p++)
+    for (int q = 0; q < nj; q++)
+    {
+      const float kx = dk * (float)frequency(p, ni);
+      const float ky = dk * (float)frequency(q, nj);
+      const float k = std::hypot(kx, ky);
+
+      if (k == 0.f)
+        continue;
+
+      float cos_wind = std::abs(kx * ca + ky * sa) / k;
+      float value = std::exp(-1.f / (k * lw * k * lw)) / (k * k * k * k) *
+                    std::pow(cos_wind, this->directional_exponent) *
+                    std::exp(-k * k / (this->k_cutoff * this->k_cutoff));
+
+      spectrum_p[p * nj + q] = value;
+      sum += value;
+
+      // deep water dispersion, quantized for a seamless loop
+      float w = std::sqrt(this->gravity * k);
+      if (this->period > 0.f)
+      {
+        float w0 = 2.f * M_PI / this->period;
+        w = std::max(1.f, std::round(w / w0)) * w0;
+      }
+      this->omega[p * nj + q] = w;
+    }
+
+  // height variance (sum of |h0(k)|^2 + |h0(-k)|^2) scaled to the
+  // amplitude
+  const float scaling = sum > 0.0 ? (float)(this->amplitude *
+                                            this->amplitude / (2.0 * sum))
+                                  : 0.f;
+
+  std::mt19937                    gen(this->seed);
+  std::normal_distribution<float> normal(0.f, 1.f);
+
+  this->h0.resize(ni * nj);
+  for (int k = 0; k < ni * nj; k++)
+  {
+    float xr = normal(gen);
+    float xi = normal(gen);
+    this->h0[k] = std::complex<float>(xr, xi) *
+                  std::sqrt(0.5f * scaling * spectrum_p[k]);
+  }
+
+  this->spectrum.resize(ni * (nj / 2 + 1));
+  this->plan_i = FFTPlan(ni);
+  this->plan_j = FFTPlan(nj / 2);
+  this->height.set_shape(this->shape);
+  std::fill(this->height.data(),
+            this->height.data() + this->height.size(),
+            0.f);
+}
+
+void SpectralOcean::synthesize(float t)
+{
+  const int ni = this->shape[0];
+  const int nj = this->shape[1];
+  const int nc = nj / 2 + 1;
+
+  // Hermitian spectrum h0(k) exp(-i w t) + conj(h0(-k)) exp(i w t),
+  // waves travel along k
+#pragma omp parallel for schedule(static)
+  for (int p = 0; p < ni; p++)
+  {
+    const int pm = (ni - p) % ni;
+
+    for (int q = 0; q < nc; q++)
+    {
+      const int                 qm = (nj - q) % nj;
+      const float               w = this->omega[p * nj + q];
+      const std::complex<float> e(std::cos(w * t), -std::sin(w * t));
+
+      this->spectrum[p * nc + q] = this->h0[p * nj + q] * e +
+                                   std::conj(this->h0[pm * nj + qm] * e);
+    }
+  }
+
+  irfft2d(this->spectrum, this->height, this->plan_i, this->plan_j);
+}
+
+float SpectralOcean::sample(float x, float y) const
+{
+  const int ni = this->height.shape[0];
+  const int nj = this->height.shape[1];
+
+  float u = (x + M_PI) / (2.f * M_PI) * (float)(this->repeat * ni);
+  float v = (y + M_PI) / (2.f * M_PI) * (float)(this->repeat * nj);
+  float uf = std::floor(u);
+  float vf = std::floor(v);
+  float tu = u - uf;
+  float tv = v - vf;
+
+  // power of two sizes
+  int p = (int)uf & (ni - 1);
+  int q = (int)vf & (nj - 1);
+  int p1 = (p + 1) & (ni - 1);
+  int q1 = (q + 1) & (nj - 1);
+
+  const Array &a = this->height;
+  return (1.f - tu) * ((1.f - tv) * a(p, q) + tv * a(p, q1)) +
+         tu * ((1.f - tv) * a(p1, q) + tv * a(p1, q1));
+}
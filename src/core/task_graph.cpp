@@ -0,0 +1,268 @@
+// Copyright (c) 2023 Otto Link. Distributed under the terms of the
+// GNU General Public License. The full license is in the file
+// LICENSE, distributed with this software.
+#include <algorithm>
+
+#include <omp.h>
+
+#include "core/task_graph.hpp"
+
+// index of the pool worker running the current thread (-1 otherwise)
+static thread_local int worker_id = -1;
+
+// pool of the graph task running in the current thread (if any)
+static thread_local const ThreadPool *task_pool = nullptr;
+
+ThreadPool::ThreadPool(int nworkers)
+    : npending(0), nrunning(0), next_queue(0)
+{
+  nworkers = std::max(1, nworkers);
+
+  for (int k = 0; k < nworkers; k++)
+    this->queues.push_back(std::unique_ptr<Queue>(new Queue()));
+
+  for (int k = 0; k < nworkers; k++)
+    this->workers.push_back(std::thread(&ThreadPool::worker_loop, this, k));
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(this->sleep_mutex);
+    this->stop = true;
+  }
+  this->sleep_cv.notify_all();
+
+  for (auto &worker : this->workers)
+    worker.join();
+}
+
+ThreadPool &ThreadPool::get_instance()
+{
+  static ThreadPool pool((int)std::thread::hardware_concurrency() - 1);
+  return pool;
+}
+
+void ThreadPool::submit(std::function<void()> task, const void *owner)
+{
+  int id = worker_id >= 0 ? worker_id
+                          : (int)(this->next_queue++ % this->queues.size());
+
+  {
+    std::lock_guard<std::mutex> lock(this->queues[id]->mutex);
+    this->queues[id]->tasks.push_back({std::move(task), owner});
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(this->sleep_mutex);
+    this->npending++;
+  }
+  this->sleep_cv.notify_one();
+}
+
+bool ThreadPool::pop_task(std::deque<Task> &tasks,
+                          const void       *owner,
+                          bool              back,
+                          Task             &task)
+{
+  const int n = (int)tasks.size();
+
+  for (int k = 0; k < n; k++)
+  {
+    int r = back ? n - 1 - k : k;
+    if (owner and tasks[r].owner != owner)
+      continue;
+
+    task = std::move(tasks[r]);
+    tasks.erase(tasks.begin() + r);
+    return true;
+  }
+
+  return false;
+}
+
+bool ThreadPool::pop(int id, const void *owner, Task &task)
+{
+  const int n = (int)this->queues.size();
+
+  // own queue first (most recent task)
+  if (id >= 0)
+  {
+    std::lock_guard<std::mutex> lock(this->queues[id]->mutex);
+    if (pop_task(this->queues[id]->tasks, owner, true, task))
+      return true;
+  }
+
+  // steal the oldest task of another queue
+  for (int k = 1; k <= n; k++)
+  {
+    int                         victim = (std::max(id, 0) + k) % n;
+    std::lock_guard<std::mutex> lock(this->queues[victim]->mutex);
+    if (pop_task(this->queues[victim]->tasks, owner, false, task))
+      return true;
+  }
+
+  return false;
+}
+
+bool ThreadPool::run_one(const void *owner)
+{
+  Task task;
+
+  if (!this->pop(worker_id, owner, task))
+    return false;
+
+  this->nrunning++;
+  this->npending--;
+  try
+  {
+    task.fct();
+  }
+  catch (...)
+  {
+    this->nrunning--;
+    throw;
+  }
+  this->nrunning--;
+  return true;
+}
+
+int ThreadPool::thread_share() const
+{
+  int ntasks = std::min(this->get_nthreads(),
+                        this->npending.load() + this->nrunning.load());
+  return std::max(1, this->get_nthreads() / std::max(1, ntasks));
+}
+
+void ThreadPool::worker_loop(int id)
+{
+  worker_id = id;
+
+  while (true)
+  {
+    if (this->run_one())
+      continue;
+
+    std::unique_lock<std::mutex> lock(this->sleep_mutex);
+    this->sleep_cv.wait(lock,
+                        [this]() { return this->stop or this->npending > 0; });
+    if (this->stop)
+      return;
+  }
+}
+
+int TaskGraph::add_task(std::function<void()> fct,
+                        std::vector<int>      dependencies)
+{
+  int id = (int)this->fcts.size();
+
+  this->fcts.push_back(fct);
+  this->successors.push_back({});
+  this->ndependencies.push_back((int)dependencies.size());
+
+  for (int k : dependencies)
+    this->successors[k].push_back(id);
+
+  return id;
+}
+
+void TaskGraph::run(ThreadPool &pool)
+{
+  const int n = (int)this->fcts.size();
+
+  std::vector<std::atomic<int>> remaining(n);
+  std::atomic<bool>             failed(false);
+  std::exception_ptr            error;
+
+  // completed tasks and events (task submitted or completed) waking up
+  // the waiting caller, guarded by 'mutex'
+  int                     ndone = 0;
+  unsigned                nevents = 0;
+  std::mutex              mutex;
+  std::condition_variable cv;
+
+  for (int k = 0; k < n; k++)
+    remaining[k] = this->ndependencies[k];
+
+  std::function<void(int)> launch;
+  launch = [&](int k)
+  {
+    pool.submit(
+        [&, k]()
+        {
+          // once a task failed, the others are skipped but still
+          // completed so that the graph runs to the end
+          if (!failed)
+          {
+            // share of the threads for the parallel regions of the task
+            const ThreadPool *pool_prev = task_pool;
+            int               nthreads_prev = omp_get_max_threads();
+            task_pool = &pool;
+            refresh_thread_share();
+
+            try
+            {
+              this->fcts[k]();
+            }
+            catch (...)
+            {
+              std::lock_guard<std::mutex> lock(mutex);
+              if (!error)
+                error = std::current_exception();
+              failed = true;
+            }
+
+            omp_set_num_threads(nthreads_prev);
+            task_pool = pool_prev;
+          }
+
+          for (int s : this->successors[k])
+            if (--remaining[s] == 0)
+              launch(s);
+
+          // notified under the lock, the caller may return as soon as
+          // it is released
+          std::lock_guard<std::mutex> lock(mutex);
+          ndone++;
+          nevents++;
+          cv.notify_all();
+        },
+        this);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    nevents++;
+    cv.notify_all();
+  };
+
+  for (int k = 0; k < n; k++)
+    if (this->ndependencies[k] == 0)
+      launch(k);
+
+  // helps with the tasks of the graph, sleeps when there is none left in
+  // the queues until a task is submitted or completed
+  while (true)
+  {
+    unsigned seen;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (ndone == n)
+        break;
+      seen = nevents;
+    }
+
+    if (pool.run_one(this))
+      continue;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&]() { return nevents != seen; });
+  }
+
+  if (error)
+    std::rethrow_exception(error);
+}
+
+void refresh_thread_share()
+{
+  if (task_pool)
+    omp_set_num_threads(task_pool->thread_share());
+}
@@ -0,0 +1,287 @@
+// Copyright (c) 2023 Otto Link. Distributed under the terms of the
+// GNU General Public License. The full license is in the file
+// LICENSE, distributed with this software.
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "macrologger.h"
+
+#include "core/hash.hpp"
+#include "core/update_cache.hpp"
+
+#ifndef UPDATE_CACHE_FORMAT_VERSION
+#error "UPDATE_CACHE_FORMAT_VERSION is not defined (see update_cache.hpp)"
+#endif
+
+#define UPDATE_CACHE_MAGIC 0x43555753 // "SWUC"
+#define UPDATE_CACHE_HEADER_SIZE 64
+#define UPDATE_CACHE_EXT ".swc"
+#define UPDATE_CACHE_NFIELDS 3
+
+struct CacheHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t key;
+  int32_t  ni;
+  int32_t  nj;
+};
+
+static_assert(sizeof(CacheHeader) <= UPDATE_CACHE_HEADER_SIZE,
+              "cache header too large");
+
+std::string default_cache_dir()
+{
+  const char *p_xdg = std::getenv("XDG_CACHE_HOME");
+  if (p_xdg and p_xdg[0])
+    return std::string(p_xdg) + "/shorewaves";
+
+  const char *p_home = std::getenv("HOME");
+  if (p_home and p_home[0])
+    return std::string(p_home) + "/.cache/shorewaves";
+
+  return "";
+}
+
+// 'mkdir -p'
+static bool make_dirs(const std::string &path)
+{
+  for (size_t k = 1; k <= path.size(); k++)
+    if (k == path.size() or path[k] == '/')
+    {
+      std::string sub = path.substr(0, k);
+      if (mkdir(sub.c_str(), 0755) != 0 and errno != EEXIST)
+        return false;
+    }
+  return true;
+}
+
+uint64_t UpdateCache::key(const WaterDepth   &depth,
+                          const GerstnerWave &wave,
+                          bool                depth_imported) const
+{
+  uint64_t hash = fnv1a(UPDATE_CACHE_FORMAT_VERSION, FNV1A_OFFSET);
+
+  if (depth_imported)
+  {
+    const Array &h = depth.h;
+    hash = fnv1a(h.shape.data(), h.shape.size() * sizeof(int), hash);
+    hash = fnv1a(h.data(), h.size() * sizeof(float), hash);
+  }
+  else
+    hash = parameters_hash(depth, hash);
+
+  // 'shore_dist' and 'phi_depth' do not depend on the other parameters
+  hash = fnv1a(wave.kinf, hash);
+  hash = fnv1a(wave.alpha, hash);
+  hash = fnv1a(wave.k_clipping_ratio, hash);
+  hash = fnv1a(wave.shore_dist_ratio, hash);
+  hash = fnv1a(wave.periodic, hash);
+
+  return hash;
+}
+
+std::string UpdateCache::get_fname(uint64_t key) const
+{
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)key);
+  return this->dir + "/" + buf + UPDATE_CACHE_EXT;
+}
+
+bool UpdateCache::load(uint64_t      key,
+                       WaterDepth   &depth,
+                       GerstnerWave &wave,
+                       bool          load_depth) const
+{
+  if (this->dir.empty())
+    return false;
+
+  std::string fname = this->get_fname(key);
+
+  int fd = open(fname.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  const int    ni = depth.shape[0];
+  const int    nj = depth.shape[1];
+  const size_t field_size = (size_t)ni * nj * sizeof(float);
+  const size_t size = UPDATE_CACHE_HEADER_SIZE +
+                      UPDATE_CACHE_NFIELDS * field_size;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 or (size_t)st.st_size != size)
+  {
+    close(fd);
+    return false;
+  }
+
+  void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (p == MAP_FAILED)
+    return false;
+
+  const CacheHeader *p_header = (const CacheHeader *)p;
+  const bool         valid = p_header->magic == UPDATE_CACHE_MAGIC and
+                     p_header->version == UPDATE_CACHE_FORMAT_VERSION and
+                     p_header->key == key and p_header->ni == ni and
+                     p_header->nj == nj;
+
+  if (valid)
+  {
+    const char *p_fields = (const char *)p + UPDATE_CACHE_HEADER_SIZE;
+
+    if (load_depth)
+    {
+      depth.h.set_shape(depth.shape);
+      std::memcpy(depth.h.data(), p_fields, field_size);
+    }
+
+    wave.shore_dist.set_shape(depth.shape);
+    wave.phi_depth.set_shape(depth.shape);
+    std::memcpy(wave.shore_dist.data(),
+                p_fields + field_size,
+                field_size);
+    std::memcpy(wave.phi_depth.data(),
+                p_fields + 2 * field_size,
+                field_size);
+  }
+
+  munmap(p, size);
+
+  if (!valid)
+    return false;
+
+  // the eviction removes the least recently used entries
+  utimes(fname.c_str(), nullptr);
+
+  wave.update_from_fields();
+  return true;
+}
+
+bool UpdateCache::store(uint64_t            key,
+                        const WaterDepth   &depth,
+                        const GerstnerWave &wave) const
+{
+  if (this->dir.empty() or !make_dirs(this->dir))
+    return false;
+
+  // written under a temporary name and renamed, so that a concurrent
+  // reader never sees a partial entry
+  std::string fname = this->get_fname(key);
+  std::string fname_tmp = fname + "." + std::to_string(getpid()) + ".tmp";
+
+  FILE *fp = std::fopen(fname_tmp.c_str(), "wb");
+  if (!fp)
+    return false;
+
+  char        header[UPDATE_CACHE_HEADER_SIZE] = {0};
+  CacheHeader h = {UPDATE_CACHE_MAGIC,
+                   UPDATE_CACHE_FORMAT_VERSION,
+                   key,
+                   depth.shape[0],
+                   depth.shape[1]};
+  std::memcpy(header, &h, sizeof(h));
+
+  const Array *fields[UPDATE_CACHE_NFIELDS] = {&depth.h,
+                                               &wave.shore_dist,
+                                               &wave.phi_depth};
+
+  bool ok = std::fwrite(header, 1, sizeof(header), fp) == sizeof(header);
+  for (int k = 0; k < UPDATE_CACHE_NFIELDS and ok; k++)
+    ok = fields[k]->shape == depth.shape and
+         std::fwrite(fields[k]->data(),
+                     sizeof(float),
+                     fields[k]->size(),
+                     fp) == fields[k]->size();
+
+  ok = (std::fclose(fp) == 0) and ok;
+  ok = ok and std::rename(fname_tmp.c_str(), fname.c_str()) == 0;
+
+  if (!ok)
+  {
+    std::remove(fname_tmp.c_str());
+    LOG_ERROR("update cache entry not written (%s)", fname.c_str());
+    return false;
+  }
+
+  this->evict();
+  return true;
+}
+
+void UpdateCache::evict() const
+{
+  DIR *p_dir = opendir(this->dir.c_str());
+  if (!p_dir)
+    return;
+
+  // (last use, file name)
+  std::vector<std::pair<time_t, std::string>> entries;
+  const std::string                           ext = UPDATE_CACHE_EXT;
+
+  while (struct dirent *p_entry = readdir(p_dir))
+  {
+    std::string name = p_entry->d_name;
+    if (name.size() <= ext.size() or
+        name.compare(name.size() - ext.size(), ext.size(), ext) != 0)
+      continue;
+
+    std::string fname = this->dir + "/" + name;
+    struct stat st;
+    if (stat(fname.c_str(), &st) == 0)
+      entries.push_back({st.st_mtime, fname});
+  }
+  closedir(p_dir);
+
+  if ((int)entries.size() <= this->max_entries)
+    return;
+
+  std::sort(entries.begin(), entries.end());
+  for (size_t k = 0; k < entries.size() - this->max_entries; k++)
+    std::remove(entries[k].second.c_str());
+}
+
+bool cached_update(UpdateCache  &cache,
+                   WaterDepth   &depth,
+                   GerstnerWave &wave,
+                   bool          update_depth,
+                   bool          depth_imported)
+{
+  if (cache.dir.empty())
+  {
+    if (update_depth and !depth_imported)
+      update_pipeline(depth, wave);
+    else
+      wave.update();
+    return false;
+  }
+
+  // an edited depth is keyed by its values unless it is regenerated
+  const bool by_values = depth_imported or (!update_depth and depth.edits > 0);
+
+  uint64_t key = cache.key(depth, wave, by_values);
+
+  if (cache.load(key, depth, wave, update_depth and !depth_imported))
+    return true;
+
+  if (update_depth and !depth_imported)
+    update_pipeline(depth, wave);
+  else
+    wave.update();
+
+  if (!wave.cancelled())
+    cache.store(key, depth, wave);
+  return false;
+}
@@ -0,0 +1,1573 @@
+// Copyright (c) 2023 Otto Link. Distributed under the terms of the
+// GNU General Public License. The full license is in the file
+// LICENSE, distributed with this software.
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <stdexcept>
+
+#include "FastNoiseLite.h"
+#include "macrologger.h"
+
+#include "shorewaves.h"
+
+#include "core/adaptive.hpp"
+#include "core/array.hpp"
+#include "core/block_compression.hpp"
+#include "core/fbm.hpp"
+#include "core/fft.hpp"
+#include "core/gerstner.hpp"
+#include "core/mesh.hpp"
+#include "core/resampling.hpp"
+#include "core/spectral.hpp"
+#include "core/task_graph.hpp"
+#include "core/validation.hpp"
+
+// --- error metrics
+
+// float bits mapped to integers ordered as the floats
+static int64_t ordered_bits(float v)
+{
+  int32_t bits;
+  std::memcpy(&bits, &v, sizeof(bits));
+  return bits < 0 ? (int64_t)std::numeric_limits<int32_t>::min() - bits
+                  : (int64_t)bits;
+}
+
+ErrorReport compare_arrays(const Array &reference, const Array &value)
+{
+  ErrorReport  error = {0.f, 0.f, 0};
+  const size_t n = reference.size();
+  double       sum = 0.0;
+
+  for (size_t k = 0; k < n; k++)
+  {
+    float   a = reference.data()[k];
+    float   b = value.data()[k];
+    double  d = std::abs((double)b - (double)a);
+    int64_t ulp = std::abs(ordered_bits(b) - ordered_bits(a));
+
+    error.max_abs = std::max(error.max_abs, (float)d);
+    error.max_ulp = std::max(error.max_ulp, ulp);
+    sum += d * d;
+  }
+
+  error.rms = n > 0 ? (float)std::sqrt(sum / (double)n) : 0.f;
+  return error;
+}
+
+bool within_budget(const ErrorReport &error, const ErrorBudget &budget)
+{
+  return (error.rms <= budget.rms) and ((error.max_abs <= budget.max_abs) or
+                                        (error.max_ulp <= budget.max_ulp));
+}
+
+// --- reference kernels
+
+Array reference_distance_transform(const Array &array, bool periodic)
+{
+  const int ni = array.shape[0];
+  const int nj = array.shape[1];
+  Array     dt = Array(array.shape);
+
+  // the closest land cell of a water cell always has a water neighbour
+  std::vector<int> border_i;
+  std::vector<int> border_j;
+
+  for (int i = 0; i < ni; i++)
+    for (int j = 0; j < nj; j++)
+    {
+      if (array(i, j) <= 0.f)
+        continue;
+
+      const int di[4] = {-1, 1, 0, 0};
+      const int dj[4] = {0, 0, -1, 1};
+
+      for (int s = 0; s < 4; s++)
+      {
+        int p = i + di[s];
+        int q = j + dj[s];
+
+        if (periodic)
+        {
+          p = (p + ni) % ni;
+          q = (q + nj) % nj;
+        }
+        else if (p < 0 or p >= ni or q < 0 or q >= nj)
+          continue;
+
+        if (array(p, q) <= 0.f)
+        {
+          border_i.push_back(i);
+          border_j.push_back(j);
+          break;
+        }
+      }
+    }
+
+  // same convention as 'distance_transform' if there is no land
+  const double inf = (double)(ni + nj);
+
+  for (int i = 0; i < ni; i++)
+    for (int j = 0; j < nj; j++)
+    {
+      if (array(i, j) > 0.f)
+      {
+        dt(i, j) = 0.f;
+        continue;
+      }
+
+      double dmin = inf * inf;
+
+      for (size_t s = 0; s < border_i.size(); s++)
+      {
+        int di = std::abs(i - border_i[s]);
+        int dj = std::abs(j - border_j[s]);
+
+        if (periodic)
+        {
+          di = std::min(di, ni - di);
+          dj = std::min(dj, nj - dj);
+        }
+        dmin = std::min(dmin, (double)(di * di + dj * dj));
+      }
+      dt(i, j) = (float)dmin;
+    }
+
+  return dt;
+}
+
+// value at (i, j), out-of-range cells (one cell away at most) are
+// linearly extrapolated or wrapped around
+static double value_at(const Array &array, int i, int j, bool periodic)
+{
+  const int ni = array.shape[0];
+  const int nj = array.shape[1];
+
+  if (periodic)
+    return array((i + ni) % ni, (j + nj) % nj);
+
+  if (i < 0)
+    return 2.0 * array(0, j) - array(1, j);
+  if (i > ni - 1)
+    return 2.0 * array(ni - 1, j) - array(ni - 2, j);
+  if (j < 0)
+    return 2.0 * array(i, 0) - array(i, 1);
+  if (j > nj - 1)
+    return 2.0 * array(i, nj - 1) - array(i, nj - 2);
+  return array(i, j);
+}
+
+Array reference_gradient_angle(const Array &array, bool periodic)
+{
+  Array gx = reference_gradient_x(array, periodic);
+  Array gy = reference_gradient_y(array, periodic);
+  Array alpha = Array(array.shape);
+
+  float *p_alpha = alpha.data();
+
+  for (size_t k = 0; k < alpha.size(); k++)
+    p_alpha[k] = (float)std::atan2((double)gy.data()[k],
+                                   (double)gx.data()[k]);
+  return alpha;
+}
+
+Array reference_gradient_x(const Array &array, bool periodic)
+{
+  Array dx = Array(array.shape);
+
+  for (int i = 0; i < array.shape[0]; i++)
+    for (int j = 0; j < array.shape[1]; j++)
+      dx(i, j) = (float)(0.5 * (value_at(array, i + 1, j, periodic) -
+                                value_at(array, i - 1, j, periodic)));
+  return dx;
+}
+
+Array reference_gradient_y(const Array &array, bool periodic)
+{
+  Array dy = Array(array.shape);
+
+  for (int i = 0; i < array.shape[0]; i++)
+    for (int j = 0; j < array.shape[1]; j++)
+      dy(i, j) = (float)(0.5 * (value_at(array, i, j + 1, periodic) -
+                                value_at(array, i, j - 1, periodic)));
+  return dy;
+}
+
+Array reference_laplacian(const Array &array, bool periodic)
+{
+  Array d2 = Array(array.shape);
+
+  for (int i = 0; i < array.shape[0]; i++)
+    for (int j = 0; j < array.shape[1]; j++)
+      d2(i, j) = (float)(value_at(array, i + 1, j, periodic) +
+                         value_at(array, i - 1, j, periodic) +
+                         value_at(array, i, j + 1, periodic) +
+                         value_at(array, i, j - 1, periodic) -
+                         4.0 * (double)array(i, j));
+  return d2;
+}
+
+Array reference_fbm_perlin(std::vector<int>   shape,
+                           std::vector<float> kw,
+                           uint               seed,
+                           int                octaves,
+                           float              weight,
+                           float              persistence,
+                           float              lacunarity,
+                           std::vector<float> shift,
+                           bool               periodic)
+{
+  Array         array = Array(shape);
+  FastNoiseLite noise(seed);
+
+  noise.SetFrequency(1.0f);
+  noise.SetNoiseType(FastNoiseLite::NoiseType_Perlin);
+  noise.SetFractalOctaves(octaves);
+  noise.SetFractalLacunarity(lacunarity);
+  noise.SetFractalGain(persistence);
+  noise.SetFractalType(FastNoiseLite::FractalType_FBm);
+  noise.SetFractalWeightedStrength(weight);
+
+  for (int i = 0; i < shape[0]; i++)
+    for (int j = 0; j < shape[1]; j++)
+    {
+      double x = (double)kw[0] * i / shape[0] + shift[0];
+      double y = (double)kw[1] * j / shape[1] + shift[1];
+      double v = noise.GetNoise(x, y);
+
+      if (periodic)
+      {
+        double u = (double)i / shape[0];
+        double w = (double)j / shape[1];
+
+        v = (1.0 - u) * (1.0 - w) * v +
+            u * (1.0 - w) * noise.GetNoise(x - kw[0], y) +
+            (1.0 - u) * w * noise.GetNoise(x, y - kw[1]) +
+            u * w * noise.GetNoise(x - kw[0], y - kw[1]);
+      }
+      array(i, j) = (float)v;
+    }
+
+  return array;
+}
+
+Array reference_irfft2d(const std::vector<std::complex<float>> &spectrum,
+                        std::vector<int>                        shape)
+{
+  typedef std::complex<double> cdouble;
+
+  const int ni = shape[0];
+  const int nj = shape[1];
+  const int nc = nj / 2 + 1;
+  Array     out = Array(shape);
+
+  // columns
+  std::vector<cdouble> col(ni * nc);
+
+  for (int i = 0; i < ni; i++)
+    for (int q = 0; q < nc; q++)
+    {
+      cdouble sum = 0.0;
+      for (int p = 0; p < ni; p++)
+      {
+        const double a = 2.0 * M_PI * (double)((p * i) % ni) / ni;
+        sum += cdouble(spectrum[p * nc + q]) *
+               cdouble(std::cos(a), std::sin(a));
+      }
+      col[i * nc + q] = sum;
+    }
+
+  // rows, the columns q > nj / 2 are conjugates
+  for (int i = 0; i < ni; i++)
+    for (int j = 0; j < nj; j++)
+    {
+      double sum = 0.0;
+      for (int q = 0; q < nj; q++)
+      {
+        const cdouble x = q < nc ? col[i * nc + q]
+                                 : std::conj(col[i * nc + nj - q]);
+        const double  a = 2.0 * M_PI * (double)((q * j) % nj) / nj;
+        sum += (x * cdouble(std::cos(a), std::sin(a))).real();
+      }
+      out(i, j) = (float)sum;
+    }
+
+  return out;
+}
+
+Array reference_resample_bilinear(const Array  &array,
+                                  const Grid   &source,
+                                  const Grid   &target,
+                                  const Affine &transform)
+{
+  const int ni = source.shape[0];
+  const int nj = source.shape[1];
+  Array     out = Array(target.shape);
+
+  for (int i = 0; i < target.shape[0]; i++)
+    for (int j = 0; j < target.shape[1]; j++)
+    {
+      double x = target.xmin + (target.xmax - target.xmin) * i /
+                                   (target.shape[0] - 1);
+      double y = target.ymin + (target.ymax - target.ymin) * j /
+                                   (target.shape[1] - 1);
+      double xt = transform.a00 * x + transform.a01 * y + transform.b0;
+      double yt = transform.a10 * x + transform.a11 * y + transform.b1;
+
+      // fractional source indices, clamped
+      double u = (xt - source.xmin) * (ni - 1) / (source.xmax - source.xmin);
+      double v = (yt - source.ymin) * (nj - 1) / (source.ymax - source.ymin);
+      u = std::min((double)(ni - 1), std::max(0.0, u));
+      v = std::min((double)(nj - 1), std::max(0.0, v));
+
+      int    p = std::min(ni - 2, (int)u);
+      int    q = std::min(nj - 2, (int)v);
+      double tu = u - p;
+      double tv = v - q;
+
+      out(i, j) = (float)((1.0 - tu) * (1.0 - tv) * array(p, q) +
+                          tu * (1.0 - tv) * array(p + 1, q) +
+                          (1.0 - tu) * tv * array(p, q + 1) +
+                          tu * tv * array(p + 1, q + 1));
+    }
+
+  return out;
+}
+
+std::vector<float> reference_decode_bc4(const uint8_t *p_data,
+                                        int            width,
+                                        int            height,
+                                        int            stride)
+{
+  const int          nbi = (width + 3) / 4;
+  std::vector<float> plane(width * height);
+
+  for (int row = 0; row < height; row++)
+    for (int col = 0; col < width; col++)
+    {
+      const uint8_t *p_block = p_data + stride * ((row / 4) * nbi + col / 4);
+      const double   r0 = p_block[0];
+      const double   r1 = p_block[1];
+
+      uint64_t bits = 0;
+      for (int b = 0; b < 6; b++)
+        bits |= (uint64_t)p_block[2 + b] << (8 * b);
+
+      const int k = 4 * (row % 4) + col % 4;
+      const int idx = (int)((bits >> (3 * k)) & 7);
+
+      // palette, 8-value mode if r0 > r1 and 6-value mode (with 0 and
+      // 255) otherwise
+      double value;
+      if (idx < 2)
+        value = idx == 0 ? r0 : r1;
+      else if (r0 > r1)
+        value = ((8 - idx) * r0 + (idx - 1) * r1) / 7.0;
+      else if (idx < 6)
+        value = ((6 - idx) * r0 + (idx - 1) * r1) / 5.0;
+      else
+        value = idx == 6 ? 0.0 : 255.0;
+
+      plane[row * width + col] = (float)(value / 255.0);
+    }
+
+  return plane;
+}
+
+std::vector<int> reference_histogram(const Array &array, int nbins)
+{
+  double vmin = array.data()[0];
+  double vmax = array.data()[0];
+  for (size_t k = 0; k < array.size(); k++)
+  {
+    vmin = std::min(vmin, (double)array.data()[k]);
+    vmax = std::max(vmax, (double)array.data()[k]);
+  }
+
+  std::vector<int> hist(nbins, 0);
+
+  for (size_t k = 0; k < array.size(); k++)
+  {
+    int b = vmax > vmin ? (int)((array.data()[k] - vmin) * nbins /
+                                (vmax - vmin))
+                        : 0;
+    hist[std::min(nbins - 1, b)]++;
+  }
+
+  return hist;
+}
+
+Array reference_shore_distance(const GerstnerWave &wave)
+{
+  Array        dt = reference_distance_transform(*wave.p_h, wave.periodic);
+  Array        sd = Array(wave.shape);
+  const double c_decay = 0.5 / std::pow((double)wave.shape[0] / wave.kinf *
+                                            wave.shore_dist_ratio,
+                                        2.0);
+
+  float *p_sd = sd.data();
+
+  for (size_t k = 0; k < sd.size(); k++)
+    p_sd[k] = (float)(1.0 - std::exp(-(double)dt.data()[k] * c_decay));
+
+  return sd;
+}
+
+static double reference_wavenumber_excess(const GerstnerWave &wave, double h)
+{
+  // no excess on land (infinite or undefined ratio, clipped)
+  double v = h < 0.0 ? 1.0 / std::sqrt(std::tanh(-wave.kinf * h))
+                     : std::numeric_limits<double>::infinity();
+  return wave.kinf * (std::min((double)wave.k_clipping_ratio, v) - 1.0);
+}
+
+// bilinear interpolation at (x, y) of the values 'f' on a grid of
+// 'ni' x 'nj' nodes spanning [-extent, extent]^2, clamped to the grid
+static double bilinear(const std::vector<double> &f,
+                       int                        ni,
+                       int                        nj,
+                       double                     extent,
+                       double                     x,
+                       double                     y)
+{
+  double u = (x + extent) * (ni - 1) / (2.0 * extent);
+  double v = (y + extent) * (nj - 1) / (2.0 * extent);
+  u = std::min((double)(ni - 1), std::max(0.0, u));
+  v = std::min((double)(nj - 1), std::max(0.0, v));
+
+  int    p = std::min(ni - 2, (int)u);
+  int    q = std::min(nj - 2, (int)v);
+  double tu = u - p;
+  double tv = v - q;
+
+  return (1.0 - tu) * ((1.0 - tv) * f[p * nj + q] + tv * f[p * nj + q + 1]) +
+         tu * ((1.0 - tv) * f[(p + 1) * nj + q] + tv * f[(p + 1) * nj + q + 1]);
+}
+
+// number of integration steps per cell along the rays
+#define REFERENCE_RAY_STEPS 4
+
+// integral of the wavenumber excess of the bilinear depth along the ray
+// through each cell, marched upstream to the edge of the rotated grid
+// of the model (the path length is scaled by cos(alpha) as in the
+// model, and each node of the model carries the integral over its own
+// cell, hence the half cell at both ends)
+static Array reference_phase_lag_ray(const GerstnerWave &wave)
+{
+  const int    ni = wave.shape[0];
+  const int    nj = wave.shape[1];
+  const Array &h = *wave.p_h;
+  const double ca = std::cos((double)wave.alpha);
+  const double sa = std::sin((double)wave.alpha);
+  const double scale = M_PI * std::sqrt(2.0);
+  const double d = 2.0 * scale / (ni - 1);
+
+  std::vector<double> hd(ni * nj);
+  for (int k = 0; k < ni * nj; k++)
+    hd[k] = h.data()[k];
+
+  Array phi = Array(wave.shape);
+
+  for (int i = 0; i < ni; i++)
+    for (int j = 0; j < nj; j++)
+    {
+      double x = -M_PI + 2.0 * M_PI * i / (ni - 1);
+      double y = -M_PI + 2.0 * M_PI * j / (nj - 1);
+      double xr = ca * x + sa * y;
+      double yr = -sa * x + ca * y;
+      double s1 = -scale - 0.5 * d;
+      double s2 = xr + 0.5 * d;
+      int    n = std::max(1,
+                       (int)std::ceil((s2 - s1) / d * REFERENCE_RAY_STEPS));
+      double ds = (s2 - s1) / n;
+      double sum = 0.0;
+
+      for (int k = 0; k < n; k++)
+      {
+        double s = s1 + (k + 0.5) * ds;
+        double hr =
+            bilinear(hd, ni, nj, M_PI, ca * s - sa * yr, sa * s + ca * yr);
+        sum += ds * reference_wavenumber_excess(wave, hr);
+      }
+
+      phi(i, j) = (float)(ca * sum);
+    }
+
+  return phi;
+}
+
+// same along the periodic rays: the depth is interpolated periodically
+// and the ray is marched from the start of its line over one period,
+// the drift (mean excess over the period) being removed
+static Array reference_phase_lag_ray_periodic(const GerstnerWave &wave)
+{
+  const int    ni = wave.shape[0];
+  const int    nj = wave.shape[1];
+  const Array &h = *wave.p_h;
+
+  float kx, ky;
+  wave.wave_vector(kx, ky);
+
+  // direction in cell units
+  double kn = std::max(1e-6, std::hypot((double)kx, (double)ky));
+  double di = kx / kn / (2.0 * M_PI / ni);
+  double dj = ky / kn / (2.0 * M_PI / nj);
+
+  const bool   march_i = std::abs(di) >= std::abs(dj);
+  const int    n1 = march_i ? ni : nj; // steps per period
+  const int    n2 = march_i ? nj : ni;
+  const bool   reverse = march_i ? di < 0.0 : dj < 0.0;
+  const double dl = 1.0 / std::max(std::abs(di), std::abs(dj));
+  double       shear = march_i ? dj / std::abs(di) : di / std::abs(dj);
+  shear = std::round(shear * n1) / n1;
+
+  // bilinear depth at (a, b) in line coordinates, periodic
+  auto depth = [&](double a, double b)
+  {
+    double af = std::floor(a);
+    double bf = std::floor(b);
+    double wa = a - af;
+    double wb = b - bf;
+    double v = 0.0;
+
+    for (int da = 0; da < 2; da++)
+      for (int db = 0; db < 2; db++)
+      {
+        int p = (((int)af + da) % n1 + n1) % n1;
+        int q = (((int)bf + db) % n2 + n2) % n2;
+        if (reverse)
+          p = n1 - 1 - p;
+        v += (da ? wa : 1.0 - wa) * (db ? wb : 1.0 - wb) *
+             (march_i ? h(p, q) : h(q, p));
+      }
+    return v;
+  };
+
+  // integral along the ray through (a, b), from s = -1/2 to 'send'
+  auto integral = [&](int a, int b, double send)
+  {
+    int    n = std::max(1,
+                       (int)std::ceil((send + 0.5) * REFERENCE_RAY_STEPS));
+    double ds = (send + 0.5) / n;
+    double sum = 0.0;
+
+    for (int k = 0; k < n; k++)
+    {
+      double s = -0.5 + (k + 0.5) * ds;
+      sum += ds * reference_wavenumber_excess(wave,
+                                              depth(s, b - shear * (a - s)));
+    }
+    return dl * sum;
+  };
+
+  Array phi = Array(wave.shape);
+
+  for (int a = 0; a < n1; a++)
+    for (int b = 0; b < n2; b++)
+    {
+      double v = integral(a, b, a + 0.5) -
+                 integral(a, b, n1 - 0.5) * (a + 1) / n1;
+      int    p = reverse ? n1 - 1 - a : a;
+
+      if (march_i)
+        phi(p, b) = (float)v;
+      else
+        phi(b, p) = (float)v;
+    }
+
+  return phi;
+}
+
+Array reference_phase_lag(const GerstnerWave &wave)
+{
+  return wave.periodic ? reference_phase_lag_ray_periodic(wave)
+                       : reference_phase_lag_ray(wave);
+}
+
+Array reference_generate(const GerstnerWave &wave, float t)
+{
+  const int    ni = wave.shape[0];
+  const int    nj = wave.shape[1];
+  const Array &h = *wave.p_h;
+  Array        dz = Array(wave.shape);
+
+  // depth-dependent fields, the phase lag of the wave itself (the
+  // reference one differs by the discretization of the integral)
+  const Array  shore_dist = reference_shore_distance(wave);
+  const Array &phi_depth = wave.phi_depth;
+
+  // grid spacing, the last node is the next tile in periodic mode
+  const double dx = 2.0 * M_PI / (wave.periodic ? ni : ni - 1);
+  const double dy = 2.0 * M_PI / (wave.periodic ? nj : nj - 1);
+
+  float kx, ky;
+  wave.wave_vector(kx, ky);
+
+  const double ca = std::cos((double)wave.alpha);
+  const double sa = std::sin((double)wave.alpha);
+  const double phase = -(double)wave.omega * t + wave.phi0;
+
+  // displaced surface
+  std::vector<double> xd(ni * nj);
+  std::vector<double> yd(ni * nj);
+  std::vector<double> zd(ni * nj);
+
+  for (int i = 0; i < ni; i++)
+    for (int j = 0; j < nj; j++)
+    {
+      const int    k = i * nj + j;
+      const double x0 = -M_PI + dx * i;
+      const double y0 = -M_PI + dy * j;
+      const double sd = shore_dist(i, j);
+      const double phi = (double)kx * x0 + (double)ky * y0 + phase +
+                         phi_depth(i, j);
+      const double rloc = wave.r * (1.0 - wave.shore_r_ratio * sd) *
+                          std::pow(sd, 0.2);
+      const double dz0 = -rloc * std::cos(phi);
+      const double ck = (1.0 - sd) * wave.kludge;
+
+      xd[k] = x0 - rloc * std::sin(phi) * ca;
+      yd[k] = y0 - rloc * std::sin(phi) * sa;
+      zd[k] = -rloc * std::cos(phi - ck * dz0);
+    }
+
+  // elevation at the grid nodes (water only)
+  const double ax = (wave.periodic ? ni : ni - 1) / (2.0 * M_PI);
+  const double ay = (wave.periodic ? nj : nj - 1) / (2.0 * M_PI);
+
+  for (int i = 0; i < ni; i++)
+    for (int j = 0; j < nj; j++)
+    {
+      if (h(i, j) >= 0.f)
+      {
+        dz(i, j) = 0.f;
+        continue;
+      }
+
+      const double u = ax * (xd[i * nj + j] + M_PI);
+      const double v = ay * (yd[i * nj + j] + M_PI);
+      int          p, q, p1, q1;
+      double       tu, tv;
+
+      if (wave.periodic)
+      {
+        tu = u - std::floor(u);
+        tv = v - std::floor(v);
+        p = (((int)std::floor(u)) % ni + ni) % ni;
+        q = (((int)std::floor(v)) % nj + nj) % nj;
+        p1 = (p + 1) % ni;
+        q1 = (q + 1) % nj;
+      }
+      else
+      {
+        if (u < 0.0 or v < 0.0 or u > ni - 1 or v > nj - 1)
+        {
+          dz(i, j) = 0.f;
+          continue;
+        }
+        p = std::min(ni - 2, (int)u);
+        q = std::min(nj - 2, (int)v);
+        p1 = p + 1;
+        q1 = q + 1;
+        tu = u - p;
+        tv = v - q;
+      }
+
+      dz(i, j) = (float)((1.0 - tu) * ((1.0 - tv) * zd[p * nj + q] +
+                                       tv * zd[p * nj + q1]) +
+                         tu * ((1.0 - tv) * zd[p1 * nj + q] +
+                               tv * zd[p1 * nj + q1]));
+    }
+
+  return dz;
+}
+
+// --- validation runs
+
+std::map<std::string, ErrorBudget> default_error_budgets()
+{
+  std::map<std::string, ErrorBudget> budgets;
+
+  budgets["distance_transform"] = {0.f, 0.f, 0};
+  budgets["fbm_perlin"] = {4e-6f, 4e-7f, 64};
+  budgets["gradient_x"] = {1e-7f, 1e-8f, 64};
+  budgets["gradient_y"] = {1e-7f, 1e-8f, 64};
+  budgets["gradient_angle"] = {4e-6f, 4e-7f, 64};
+  budgets["laplacian"] = {2e-6f, 4e-7f, 64};
+  budgets["stats"] = {1e-6f, 1e-7f, 16};
+  budgets["task_graph"] = {0.f, 0.f, 0};
+  budgets["update_region"] = {0.f, 0.f, 0};
+  budgets["c_interface"] = {0.f, 0.f, 0};
+  budgets["irfft2d"] = {4e-6f, 1e-6f, 1024};
+  budgets["shore_distance"] = {2e-7f, 5e-8f, 256};
+  // float weights of the plans
+  budgets["resampling"] = {1e-5f, 1e-6f, 1024};
+  // values on a bin edge may fall in the neighbouring bin
+  budgets["histogram"] = {1.f, 0.2f, 0};
+  // half a palette step of a block spanning the whole range and the
+  // rounding of the endpoints (the rms one for the steep blocks of the
+  // small test shapes)
+  budgets["bc4"] = {1.f / 14.f + 1.f / 255.f, 1.5e-2f, 0};
+  budgets["bc5"] = {1.f / 14.f + 1.f / 255.f, 1.5e-2f, 0};
+  // area summed in double precision from the float grid
+  budgets["mesh"] = {1e-6f, 1e-6f, 0};
+  // discretization of the integral against the ray marching: first
+  // order at the coast, where the excess jumps to its clipped value
+  // (up to half a cell of it, 0.85 at 64 cells)
+  budgets["phase_lag"] = {0.7f, 0.12f, 0};
+  // the open water cells use the deep water amplitude
+  budgets["generate"] = {1e-5f, 1e-6f, 1024};
+  // discretization error of the two-level model (the wave amplitude is
+  // 0.15), on the interior and on the shore band only: the phase lag is
+  // seeded from the coarse grid in open water. In periodic mode the
+  // phase drift along the lines comes from the coarse level as well
+  budgets["adaptive"] = {3e-2f, 3.5e-3f, 0};
+  budgets["adaptive_band"] = {3e-2f, 6e-3f, 0};
+  budgets["adaptive_periodic"] = {7e-2f, 1e-2f, 0};
+  budgets["adaptive_band_periodic"] = {7e-2f, 1.2e-2f, 0};
+  // border strip of the non periodic mode, cells flipping between zero
+  // and the full elevation (see 'validate_kernels')
+  budgets["adaptive_border"] = {0.15f, 3.5e-3f, 0};
+  return budgets;
+}
+
+static bool save_golden(const std::string &fname, const Array &array)
+{
+  FILE *fp = std::fopen(fname.c_str(), "wb");
+  if (!fp)
+    return false;
+
+  int32_t shape[2] = {array.shape[0], array.shape[1]};
+  bool    ok = std::fwrite(shape, sizeof(int32_t), 2, fp) == 2 and
+            std::fwrite(array.data(),
+                        sizeof(float),
+                        array.size(),
+                        fp) == array.size();
+
+  return (std::fclose(fp) == 0) and ok;
+}
+
+static bool load_golden(const std::string &fname, Array &array)
+{
+  FILE *fp = std::fopen(fname.c_str(), "rb");
+  if (!fp)
+    return false;
+
+  int32_t shape[2];
+  bool    ok = std::fread(shape, sizeof(int32_t), 2, fp) == 2 and
+            shape[0] > 0 and shape[1] > 0;
+
+  if (ok)
+  {
+    array.set_shape({shape[0], shape[1]});
+    ok = std::fread(array.data(),
+                    sizeof(float),
+                    array.size(),
+                    fp) == array.size();
+  }
+
+  std::fclose(fp);
+  return ok;
+}
+
+static void log_result(const ValidationResult &res)
+{
+  if (res.passed)
+    LOG_INFO("%-18s %-26s vs %-9s max %.2e rms %.2e ulp %lld",
+             res.kernel.c_str(),
+             res.label.c_str(),
+             res.against.c_str(),
+             res.error.max_abs,
+             res.error.rms,
+             (long long)res.error.max_ulp);
+  else
+    LOG_ERROR("%-18s %-26s vs %-9s max %.2e rms %.2e ulp %lld (over budget)",
+              res.kernel.c_str(),
+              res.label.c_str(),
+              res.against.c_str(),
+              res.error.max_abs,
+              res.error.rms,
+              (long long)res.error.max_ulp);
+}
+
+// number of values differing bitwise (all of them if the sizes differ)
+template <typename T>
+static size_t bitwise_mismatch(const std::vector<T> &reference,
+                               const std::vector<T> &value)
+{
+  if (reference.size() != value.size())
+    return std::max(reference.size(), value.size());
+
+  size_t count = 0;
+  for (size_t k = 0; k < value.size(); k++)
+    if (std::memcmp(&reference[k], &value[k], sizeof(T)) != 0)
+      count++;
+  return count;
+}
+
+// values as a single row array
+template <typename T> static Array row_array(const std::vector<T> &values)
+{
+  Array array = Array({1, (int)values.size()});
+  std::copy(values.begin(), values.end(), array.data());
+  return array;
+}
+
+static size_t bitwise_mismatch(const Array &reference, const Array &value)
+{
+  return bitwise_mismatch(reference.get_vector(), value.get_vector());
+}
+
+// angles compared modulo 2 pi
+static Array unwrap_angle(const Array &reference, const Array &value)
+{
+  Array  out = Array(reference.shape);
+  float *p_out = out.data();
+
+  for (size_t k = 0; k < out.size(); k++)
+  {
+    double d = (double)reference.data()[k] - (double)value.data()[k];
+    d -= 2.0 * M_PI * std::round(d / (2.0 * M_PI));
+    p_out[k] = (float)((double)value.data()[k] + d);
+  }
+  return out;
+}
+
+std::vector<ValidationResult> validate_kernels(const ValidationConfig &config)
+{
+  std::vector<ValidationResult> results;
+
+  auto check = [&config, &results](const std::string &kernel,
+                                   const std::string &label,
+                                   const Array       &reference,
+                                   const Array       &value)
+  {
+    std::map<std::string, ErrorBudget>::const_iterator it =
+        config.budgets.find(kernel);
+    const ErrorBudget budget = it != config.budgets.end()
+                                   ? it->second
+                                   : ErrorBudget({0.f, 0.f, 0});
+
+    ValidationResult res = {kernel,
+                            label,
+                            "reference",
+                            compare_arrays(reference, value),
+                            false};
+    res.passed = within_budget(res.error, budget);
+    log_result(res);
+    results.push_back(res);
+
+    if (config.golden_dir.empty())
+      return;
+
+    std::string fname = config.golden_dir + "/" + kernel + "_" + label +
+                        ".bin";
+
+    if (config.update_golden)
+    {
+      if (!save_golden(fname, value))
+        LOG_ERROR("golden output not written (%s)", fname.c_str());
+      return;
+    }
+
+    Array golden = Array({0, 0});
+    res.against = "golden";
+
+    if (load_golden(fname, golden) and golden.shape == value.shape)
+    {
+      res.error = compare_arrays(golden, value);
+      res.passed = within_budget(res.error, budget);
+      log_result(res);
+    }
+    else
+    {
+      LOG_ERROR("golden output missing (%s)", fname.c_str());
+      res.error = {std::numeric_limits<float>::max(),
+                   std::numeric_limits<float>::max(),
+                   std::numeric_limits<int64_t>::max()};
+      res.passed = false;
+    }
+    results.push_back(res);
+  };
+
+  // task graph with a failing task: its exception is rethrown by 'run'
+  // once the other tasks are done, its successor is skipped (the
+  // results are the flag 'rethrown' and the number of tasks run)
+  {
+    TaskGraph        graph;
+    std::atomic<int> nrun(0);
+    std::vector<int> roots;
+
+    for (int k = 0; k < 16; k++)
+      roots.push_back(graph.add_task([&nrun]() { nrun++; }));
+
+    int t_fail = graph.add_task([]() { throw std::runtime_error("task"); },
+                                roots);
+    graph.add_task([&nrun]() { nrun++; }, {t_fail});
+
+    bool rethrown = false;
+    try
+    {
+      graph.run();
+    }
+    catch (const std::runtime_error &)
+    {
+      rethrown = true;
+    }
+
+    Array ref = Array({1, 2});
+    Array value = Array({1, 2});
+    ref(0, 0) = 1.f;
+    ref(0, 1) = 16.f;
+    value(0, 0) = rethrown ? 1.f : 0.f;
+    value(0, 1) = (float)nrun.load();
+    check("task_graph", "exception", ref, value);
+  }
+
+  // C interface with failing allocations: the update returns an error
+  // code (the exceptions of the graph tasks included) and the model can
+  // be updated again once memory is available (the results are the
+  // status codes, and 1 if 'sw_create' returned NULL)
+  if (config.set_allocation_limit)
+  {
+    const int    n = 512;
+    const size_t field_size = (size_t)n * n * sizeof(float);
+
+    sw_model *p_model = sw_create(n, n);
+
+    config.set_allocation_limit(field_size / 4);
+    int       status_failed = sw_update(p_model);
+    sw_model *p_none = sw_create(n, n);
+    config.set_allocation_limit(0);
+
+    int status = sw_update(p_model);
+
+    std::vector<float> out(n * n);
+    int                status_generate = sw_generate(p_model,
+                                          0.f,
+                                          out.data(),
+                                          n * sizeof(float),
+                                          sizeof(float));
+
+    Array ref = Array({1, 4});
+    Array value = Array({1, 4});
+    ref(0, 0) = (float)SW_ERROR_OUT_OF_MEMORY;
+    ref(0, 1) = 1.f;
+    ref(0, 2) = (float)SW_OK;
+    ref(0, 3) = (float)SW_OK;
+    value(0, 0) = (float)status_failed;
+    value(0, 1) = p_none ? 0.f : 1.f;
+    value(0, 2) = (float)status;
+    value(0, 3) = (float)status_generate;
+    check("c_interface", "allocation_failure", ref, value);
+
+    sw_destroy(p_none);
+    sw_destroy(p_model);
+  }
+
+  // inverse FFT of a random spectrum, Hermitian on the columns 0 and
+  // nj / 2
+  auto check_irfft2d = [&check](const std::string &label,
+                                std::vector<int>   shape,
+                                uint               seed)
+  {
+    const int nc = shape[1] / 2 + 1;
+    const int n = shape[0] * nc;
+
+    std::mt19937                     gen(seed);
+    std::normal_distribution<float>  normal(0.f, 1.f / std::sqrt(n));
+    std::vector<std::complex<float>> spectrum(n);
+
+    for (auto &v : spectrum)
+      v = std::complex<float>(normal(gen), normal(gen));
+
+    for (int q = 0; q < nc; q += nc - 1)
+      for (int p = 0; p < shape[0]; p++)
+      {
+        const int pm = (shape[0] - p) % shape[0];
+        if (p == pm)
+          spectrum[p * nc + q].imag(0.f);
+        else if (p < pm)
+          spectrum[pm * nc + q] = std::conj(spectrum[p * nc + q]);
+      }
+
+    Array                            fft = Array(shape);
+    std::vector<std::complex<float>> buffer = spectrum;
+    irfft2d(buffer, fft, FFTPlan(shape[0]), FFTPlan(shape[1] / 2));
+
+    check("irfft2d", label, reference_irfft2d(spectrum, shape), fft);
+  };
+
+  for (auto &shape : config.fft_shapes)
+    for (auto seed : config.seeds)
+    {
+      char buf[64];
+      std::snprintf(buf, sizeof(buf), "%dx%d_seed%u", shape[0], shape[1], seed);
+      check_irfft2d(buf, shape, seed);
+    }
+
+  for (auto &shape : config.shapes)
+    for (auto seed : config.seeds)
+      for (int p = 0; p < 2; p++)
+      {
+        const bool periodic = p == 1;
+        char       buf[64];
+
+        std::snprintf(buf,
+                      sizeof(buf),
+                      "%dx%d_seed%u%s",
+                      shape[0],
+                      shape[1],
+                      seed,
+                      periodic ? "_periodic" : "");
+        const std::string label = buf;
+
+        // parameters spread with the seed
+        WaterDepth depth = WaterDepth(shape);
+        depth.seed = seed;
+        depth.kw = {1.f + (float)(seed % 3), 2.f + (float)(seed % 5)};
+        depth.octaves = 3 + (int)(seed % 4);
+        depth.periodic = periodic;
+        if (periodic)
+          depth.offset = -0.1f; // islands, since there is no slope
+        depth.update();
+
+        check("fbm_perlin",
+              label,
+              reference_fbm_perlin(shape,
+                                   depth.kw,
+                                   seed,
+                                   depth.octaves,
+                                   depth.weight,
+                                   depth.persistence,
+                                   depth.lacunarity,
+                                   {0.f, 0.f},
+                                   periodic),
+              fbm_perlin(shape,
+                         depth.kw,
+                         seed,
+                         depth.octaves,
+                         depth.weight,
+                         depth.persistence,
+                         depth.lacunarity,
+                         {0.f, 0.f},
+                         periodic));
+
+        const Array &h = depth.h;
+
+        check("distance_transform",
+              label,
+              reference_distance_transform(h, periodic),
+              distance_transform(h, periodic));
+        check("gradient_x",
+              label,
+              reference_gradient_x(h, periodic),
+              gradient_x(h, periodic));
+        check("gradient_y",
+              label,
+              reference_gradient_y(h, periodic),
+              gradient_y(h, periodic));
+
+        Array alpha = gradient_angle(h, periodic);
+        check("gradient_angle",
+              label,
+              unwrap_angle(reference_gradient_angle(h, periodic), alpha),
+              alpha);
+
+        check("laplacian",
+              label,
+              reference_laplacian(h, periodic),
+              laplacian(h, periodic));
+
+        // min / max / mean, and max after a write to a copy whose
+        // statistics are cached
+        double vmin = h.data()[0];
+        double vmax = h.data()[0];
+        double sum = 0.0;
+        for (size_t k = 0; k < h.size(); k++)
+        {
+          vmin = std::min(vmin, (double)h.data()[k]);
+          vmax = std::max(vmax, (double)h.data()[k]);
+          sum += h.data()[k];
+        }
+
+        Array h_edit = h;
+        h_edit.max();
+        h_edit(0, 0) = (float)vmax + 1.f;
+
+        Array stats_ref = Array({1, 4});
+        Array stats = Array({1, 4});
+        stats_ref(0, 0) = (float)vmin;
+        stats_ref(0, 1) = (float)vmax;
+        stats_ref(0, 2) = (float)(sum / (double)h.size());
+        stats_ref(0, 3) = (float)vmax + 1.f;
+        stats(0, 0) = h.min();
+        stats(0, 1) = h.max();
+        stats(0, 2) = h.mean();
+        stats(0, 3) = h_edit.max();
+        check("stats", label, stats_ref, stats);
+
+        // inverse FFT (non-periodic runs only, the transform does not
+        // depend on it)
+        if (!periodic and is_power_of_two(shape[0]) and
+            is_power_of_two(shape[1]))
+          check_irfft2d(label, shape, seed);
+
+        // waves
+        GerstnerWave wave = GerstnerWave(depth.h);
+        wave.alpha = 0.3f + 0.7f * (float)seed;
+        wave.periodic = periodic;
+        wave.update();
+
+        check("shore_distance",
+              label,
+              reference_shore_distance(wave),
+              wave.shore_dist);
+        check("phase_lag", label, reference_phase_lag(wave), wave.phi_depth);
+
+        for (auto t : config.times)
+        {
+          std::snprintf(buf, sizeof(buf), "_t%.2f", t);
+          wave.generate(t);
+          check("generate",
+                label + buf,
+                reference_generate(wave, t),
+                wave.dz);
+        }
+
+        check("histogram",
+              label,
+              row_array(reference_histogram(h_edit, 64)),
+              row_array(h_edit.histogram(64)));
+
+        // resampling plans of the phase lag, to the rotated grid and back
+        // (non periodic runs only, the plans do not depend on it)
+        if (!periodic)
+        {
+          const float  ca = std::cos(wave.alpha);
+          const float  sa = std::sin(wave.alpha);
+          const float  scale = M_PI * M_SQRT2;
+          const Grid   grid = {shape, -M_PI, M_PI, -M_PI, M_PI};
+          const Grid   grid_r = {shape, -scale, scale, -scale, scale};
+          const Affine rotation = {ca, -sa, sa, ca, 0.f, 0.f};
+          const Affine rotation_inv = {ca, sa, -sa, ca, 0.f, 0.f};
+
+          Array h_r =
+              get_resampling_plan(grid, grid_r, rotation, RESAMPLING_BILINEAR)
+                  ->apply(h);
+
+          check("resampling",
+                label,
+                reference_resample_bilinear(h, grid, grid_r, rotation),
+                h_r);
+          check("resampling",
+                label + "_inverse",
+                reference_resample_bilinear(h_r, grid_r, grid, rotation_inv),
+                get_resampling_plan(grid_r,
+                                    grid,
+                                    rotation_inv,
+                                    RESAMPLING_BILINEAR)
+                    ->apply(h_r));
+        }
+
+        // block compression round trip, cropped to partial blocks: the
+        // elevation mapped from [-r, r] to [0, 1] (BC4) and the shore
+        // distance with it (BC5)
+        {
+          const int          width = shape[1] - 1;
+          const int          height = shape[0] - 2;
+          std::vector<float> plane_r(width * height);
+          std::vector<float> plane_g(width * height);
+
+          for (int row = 0; row < height; row++)
+            for (int col = 0; col < width; col++)
+            {
+              float v = 0.5f * (wave.dz(row, col) / wave.r + 1.f);
+              plane_r[row * width + col] = std::min(1.f, std::max(0.f, v));
+              plane_g[row * width + col] = wave.shore_dist(row, col);
+            }
+
+          std::vector<uint8_t> bc4 = compress_bc4(plane_r, width, height);
+          std::vector<uint8_t> bc5 = compress_bc5(plane_r,
+                                                  plane_g,
+                                                  width,
+                                                  height);
+
+          check("bc4",
+                label,
+                row_array(plane_r),
+                row_array(reference_decode_bc4(bc4.data(), width, height)));
+
+          std::vector<float> planes = plane_r;
+          std::vector<float> decoded =
+              reference_decode_bc4(bc5.data(), width, height, 16);
+          std::vector<float> decoded_g =
+              reference_decode_bc4(bc5.data() + 8, width, height, 16);
+
+          planes.insert(planes.end(), plane_g.begin(), plane_g.end());
+          decoded.insert(decoded.end(), decoded_g.begin(), decoded_g.end());
+          check("bc5", label, row_array(planes), row_array(decoded));
+        }
+
+        // surface mesh (non periodic runs only): the grid triangles cover
+        // the domain once, counter-clockwise on the undisplaced grid, each
+        // skirt vertex hangs below a border vertex and the vertices are
+        // the displaced positions. The results are the triangle and
+        // vertex counts, the numbers of out-of-range indices, flipped
+        // triangles, misplaced skirt and grid vertices, the area covered
+        // relative to the domain and the max. error of the deep water
+        // detail
+        if (!periodic)
+        {
+          const int   step = 3;
+          const float skirt = 0.1f;
+          SurfaceMesh mesh = SurfaceMesh(shape, step, skirt);
+
+          const size_t       nv = mesh.get_nvertices();
+          std::vector<float> vertices(3 * nv);
+          mesh.write_vertices(wave,
+                              config.times.back(),
+                              vertices.data(),
+                              3 * sizeof(float));
+
+          // grid nodes of the vertices, the last node being included
+          std::vector<int> rows, cols;
+          for (int k = 0; k < shape[0] - 1; k += step)
+            rows.push_back(k);
+          rows.push_back(shape[0] - 1);
+          for (int k = 0; k < shape[1] - 1; k += step)
+            cols.push_back(k);
+          cols.push_back(shape[1] - 1);
+
+          const size_t nb = cols.size();
+          const size_t ngrid = rows.size() * nb;
+          const size_t ntri_grid = 2 * (rows.size() - 1) * (nb - 1);
+          const size_t nring = 2 * (rows.size() - 1) + 2 * (nb - 1);
+          const size_t ntri = mesh.indices.size() / 3;
+
+          size_t out_of_range = 0;
+          size_t flipped = 0;
+          size_t skirt_mismatch = 0;
+          size_t vertex_mismatch = 0;
+          double area = 0.0;
+
+          for (size_t tri = 0; tri < ntri; tri++)
+          {
+            const uint32_t *p_tri = &mesh.indices[3 * tri];
+
+            if (p_tri[0] >= nv or p_tri[1] >= nv or p_tri[2] >= nv)
+            {
+              out_of_range++;
+              continue;
+            }
+
+            if (tri < ntri_grid)
+            {
+              double x[3], y[3];
+              bool   grid_vertices = true;
+
+              for (int c = 0; c < 3; c++)
+              {
+                if (p_tri[c] >= ngrid)
+                {
+                  grid_vertices = false;
+                  break;
+                }
+                int i = rows[p_tri[c] / nb];
+                int j = cols[p_tri[c] % nb];
+                x[c] = wave.x0(i, j);
+                y[c] = wave.y0(i, j);
+              }
+
+              double cross = (x[1] - x[0]) * (y[2] - y[0]) -
+                             (y[1] - y[0]) * (x[2] - x[0]);
+              if (!grid_vertices or cross <= 0.0)
+                flipped++;
+              else
+                area += 0.5 * cross;
+            }
+            else if ((tri - ntri_grid) % 2 == 0)
+            {
+              // (border vertex, next border vertex, skirt vertex below
+              // the first one)
+              const float *p_v = &vertices[3 * p_tri[0]];
+              const float *p_s = &vertices[3 * p_tri[2]];
+
+              if (p_tri[0] >= ngrid or p_tri[2] < ngrid or
+                  p_s[0] != p_v[0] or p_s[1] != p_v[1] or
+                  p_s[2] != p_v[2] - skirt)
+                skirt_mismatch++;
+            }
+          }
+
+          for (size_t a = 0; a < rows.size(); a++)
+            for (size_t b = 0; b < nb; b++)
+            {
+              const float *p_v = &vertices[3 * (a * nb + b)];
+              const int    i = rows[a];
+              const int    j = cols[b];
+
+              if (p_v[0] != wave.x_disp(i, j) or p_v[1] != wave.y_disp(i, j) or
+                  p_v[2] != wave.dz_disp(i, j))
+                vertex_mismatch++;
+            }
+
+          // deep water detail, at the displaced positions
+          SpectralOcean spectral = SpectralOcean(false);
+          spectral.shape = {32, 32};
+          spectral.update();
+
+          std::vector<float> vertices_spectral(3 * nv);
+          wave.p_spectral = &spectral;
+          mesh.write_vertices(wave,
+                              config.times.back(),
+                              vertices_spectral.data(),
+                              3 * sizeof(float));
+          wave.p_spectral = nullptr;
+
+          double spectral_error = 0.0;
+
+          for (size_t a = 0; a < rows.size(); a++)
+            for (size_t b = 0; b < nb; b++)
+            {
+              const float *p_v = &vertices[3 * (a * nb + b)];
+              const float *p_vs = &vertices_spectral[3 * (a * nb + b)];
+              const double z = p_v[2] + wave.shore_dist(rows[a], cols[b]) *
+                                            spectral.sample(p_v[0], p_v[1]);
+
+              spectral_error = std::max(spectral_error,
+                                        std::abs(p_vs[2] - z));
+            }
+
+          Array ref = Array({1, 8});
+          Array value = Array({1, 8});
+          ref(0, 0) = (float)(ntri_grid + 2 * nring);
+          ref(0, 1) = (float)(ngrid + nring);
+          ref(0, 6) = 1.f;
+          value(0, 0) = (float)ntri;
+          value(0, 1) = (float)nv;
+          value(0, 2) = (float)out_of_range;
+          value(0, 3) = (float)flipped;
+          value(0, 4) = (float)skirt_mismatch;
+          value(0, 5) = (float)vertex_mismatch;
+          value(0, 6) = (float)(area / (4.0 * M_PI * M_PI));
+          value(0, 7) = (float)spectral_error;
+          check("mesh", label, ref, value);
+        }
+      }
+
+  // local updates after random brush strokes against a full update of
+  // the edited depth: the fields are expected to be bitwise identical
+  // (the results are the numbers of differing values, per field, and 1
+  // if the restored wave had no valid intermediate fields)
+  for (auto &shape : config.region_shapes)
+    for (auto seed : config.seeds)
+      for (int p = 0; p < 2; p++)
+      {
+        const bool periodic = p == 1;
+        char       buf[64];
+
+        std::snprintf(buf,
+                      sizeof(buf),
+                      "%dx%d_seed%u%s",
+                      shape[0],
+                      shape[1],
+                      seed,
+                      periodic ? "_periodic" : "");
+
+        WaterDepth depth = WaterDepth(shape, false);
+        depth.seed = seed;
+        depth.periodic = periodic;
+        if (periodic)
+          depth.offset = -0.1f;
+        depth.update();
+
+        GerstnerWave wave = GerstnerWave(depth.h, false);
+        wave.alpha = 0.3f + 0.7f * (float)seed;
+        wave.periodic = periodic;
+        wave.update();
+
+        // same fields restored (e.g. from the cache), with the
+        // intermediate fields rebuilt apart
+        GerstnerWave restored = GerstnerWave(depth.h, false);
+        copy_parameters(wave, restored);
+        restored.shore_dist = wave.shore_dist;
+        restored.phi_depth = wave.phi_depth;
+        restored.update_from_fields();
+        restored.update_region_fields();
+
+        // the brush strokes are local updates of both waves
+        const bool key_mismatch = restored.region_key != wave.region_key;
+
+        std::mt19937                          gen(seed);
+        std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+        for (int k = 0; k < config.region_brushes; k++)
+        {
+          int i1, i2, j1, j2;
+          depth.apply_brush(unit(gen) * (float)shape[0],
+                            unit(gen) * (float)shape[1],
+                            2.f + 22.f * unit(gen),
+                            0.4f * unit(gen) - 0.2f,
+                            i1,
+                            i2,
+                            j1,
+                            j2);
+          wave.update_region(i1, i2, j1, j2);
+          restored.update_region(i1, i2, j1, j2);
+        }
+
+        GerstnerWave fresh = GerstnerWave(depth.h, false);
+        copy_parameters(wave, fresh);
+        fresh.update();
+
+        fresh.generate(config.times.back());
+
+        for (GerstnerWave *p_wave : {&wave, &restored})
+        {
+          GerstnerWave &w = *p_wave;
+          w.generate(config.times.back());
+
+          Array ref = Array({1, 8});
+          Array value = Array({1, 8});
+          value(0, 0) = (float)bitwise_mismatch(fresh.shore_dist,
+                                                w.shore_dist);
+          value(0, 1) = (float)bitwise_mismatch(fresh.phi_depth,
+                                                w.phi_depth);
+          value(0, 2) = (float)bitwise_mismatch(fresh.dt, w.dt);
+          value(0, 3) = (float)bitwise_mismatch(fresh.spans_land,
+                                                w.spans_land);
+          value(0, 4) = (float)bitwise_mismatch(fresh.spans_shore,
+                                                w.spans_shore);
+          value(0, 5) = (float)bitwise_mismatch(fresh.spans_open,
+                                                w.spans_open);
+          value(0, 6) = (float)bitwise_mismatch(fresh.dz, w.dz);
+          value(0, 7) = p_wave == &restored and key_mismatch ? 1.f : 0.f;
+          check("update_region",
+                std::string(buf) + (p_wave == &restored ? "_restored" : ""),
+                ref,
+                value);
+        }
+      }
+
+  for (auto &shape : config.adaptive_shapes)
+    for (auto seed : config.seeds)
+      for (int p = 0; p < 2; p++)
+      {
+        const bool periodic = p == 1;
+        char       buf[64];
+
+        std::snprintf(buf,
+                      sizeof(buf),
+                      "%dx%d_seed%u%s",
+                      shape[0],
+                      shape[1],
+                      seed,
+                      periodic ? "_periodic" : "");
+        const std::string label = buf;
+
+        WaterDepth depth = WaterDepth(shape, false);
+        depth.seed = seed;
+        depth.periodic = periodic;
+        if (periodic)
+          depth.offset = -0.1f;
+        depth.update();
+
+        GerstnerWave wave = GerstnerWave(depth.h, false);
+        wave.alpha = 0.3f + 0.7f * (float)seed;
+        wave.periodic = periodic;
+        wave.update();
+
+        AdaptiveWave adaptive = AdaptiveWave(depth.h, false);
+        copy_parameters(wave, adaptive.coarse);
+        adaptive.update();
+
+        for (auto t : config.times)
+        {
+          std::snprintf(buf, sizeof(buf), "_t%.2f", t);
+          wave.generate(t);
+          adaptive.generate(t);
+
+          const std::string suffix = periodic ? "_periodic" : "";
+
+          // the elevation is zero where the displaced position falls
+          // outside the domain (non periodic mode): next to the borders
+          // a small shift of the two models' displacements flips cells
+          // between zero and the full elevation, this strip is reported
+          // apart
+          const int ni = shape[0];
+          const int nj = shape[1];
+          auto strip_width = [&](int n)
+          {
+            return periodic ? 0
+                            : (int)std::ceil(wave.r * (float)(n - 1) /
+                                             (2.f * (float)M_PI)) +
+                                  1;
+          };
+          const int mi = strip_width(ni);
+          const int mj = strip_width(nj);
+
+          // interior cells, water cells of the shore band (interior as
+          // well) and border strip
+          std::vector<float> inner_ref, inner, band_ref, band, strip_ref,
+              strip;
+
+          const Array &h = depth.h;
+          const Array &shore_dist = wave.shore_dist;
+          const Array &dz_ref = wave.dz;
+          const Array &dz = adaptive.dz;
+
+          for (int i = 0; i < ni; i++)
+            for (int j = 0; j < nj; j++)
+            {
+              if (i < mi or j < mj or i >= ni - mi or j >= nj - mj)
+              {
+                strip_ref.push_back(dz_ref(i, j));
+                strip.push_back(dz(i, j));
+                continue;
+              }
+
+              inner_ref.push_back(dz_ref(i, j));
+              inner.push_back(dz(i, j));
+
+              if (h(i, j) < 0.f and shore_dist(i, j) < 0.5f)
+              {
+                band_ref.push_back(dz_ref(i, j));
+                band.push_back(dz(i, j));
+              }
+            }
+
+          auto check_cells = [&](const std::string        &kernel,
+                                 const std::vector<float> &ref,
+                                 const std::vector<float> &value)
+          {
+            if (value.empty())
+              return;
+
+            Array ref_array = Array({1, (int)ref.size()});
+            Array value_array = Array({1, (int)value.size()});
+            std::copy(ref.begin(), ref.end(), ref_array.data());
+            std::copy(value.begin(), value.end(), value_array.data());
+            check(kernel, label + buf, ref_array, value_array);
+          };
+
+          check_cells("adaptive" + suffix, inner_ref, inner);
+          check_cells("adaptive_band" + suffix, band_ref, band);
+          check_cells("adaptive_border", strip_ref, strip);
+        }
+      }
+
+  return results;
+}
+
+bool all_passed(const std::vector<ValidationResult> &results)
+{
+  for (auto &res : results)
+    if (!res.passed)
+      return false;
+  return true;
+}
@@ -1,6 +1,8 @@
 // Copyright (c) 2023 Otto Link. Distributed under the terms of the
 // GNU General Public License. The full license is in the file
 // LICENSE, distributed with this software.
+#include <cfloat>
+#include <cstdio>
 #include <iostream>
 
 #include <GLFW/glfw3.h>
@@ -8,9 +10,14 @@
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
 
+#include "core/adaptive.hpp"
 #include "core/array.hpp"
 #include "core/fbm.hpp"
+#include "core/flipbook.hpp"
+#include "core/frame_publisher.hpp"
 #include "core/gerstner.hpp"
+#include "core/progressive.hpp"
+#include "core/update_cache.hpp"
 #include "gui/gui.hpp"
 #include "gui/utils.hpp"
 
@@ -27,12 +34,39 @@ int main()
 
   std::vector<int> shape = {512, 512};
 
-  WaterDepth    depth = WaterDepth(shape);
-  GuiWaterDepth depth_gui = GuiWaterDepth(depth);
+  // a known scene is restored from the disk cache
+  UpdateCache  cache;
+  WaterDepth   depth = WaterDepth(shape, false);
+  GerstnerWave wave = GerstnerWave(depth.h, false);
+  cached_update(cache, depth, wave);
 
-  GerstnerWave    wave = GerstnerWave(depth.h);
+  GuiWaterDepth   depth_gui = GuiWaterDepth(depth);
   GuiGerstnerWave wave_gui = GuiGerstnerWave(wave);
 
+  // coarse preview while the parameters are being edited
+  ProgressiveUpdate progressive(depth, wave);
+  progressive.p_cache = &cache;
+
+  // two-level model for large domains (full resolution in the shore
+  // band only), updated once the input is idle
+  AdaptiveWave adaptive(depth.h, false);
+  bool         use_adaptive = false;
+  bool         adaptive_outdated = false;
+  bool         adaptive_depth_outdated = false;
+
+  // FFT deep water detail, blended away from the shore
+  SpectralOcean    spectral = SpectralOcean(false);
+  GuiSpectralOcean spectral_gui = GuiSpectralOcean(spectral);
+  bool             use_spectral = false;
+
+  // dz frames shared with other processes
+  FramePublisher publisher;
+
+  // sea floor brush (left button raises, right button lowers)
+  bool  brush = false;
+  float brush_radius = 16.f;
+  float brush_strength = 0.5f;
+
   while (!glfwWindowShouldClose(window))
   {
     glfwPollEvents();
@@ -52,14 +86,89 @@ int main()
       depth_gui.render();
 
       ImGui::SeparatorText("Ocean waves");
+      wave_gui.render();
+
+      ImGui::SeparatorText("Shore band refinement");
 
-      if (depth_gui.updated)
+      if (ImGui::Checkbox("Adaptive model (coarse open water)", &use_adaptive))
       {
+        depth_gui.set_max_size(use_adaptive ? 8192 : 2048);
+
+        if (use_adaptive)
+        {
+          progressive.finish();
+          adaptive_outdated = true;
+        }
+        else
+          progressive.request(adaptive_depth_outdated);
+        adaptive_depth_outdated = false;
+      }
+
+      if (ImGui::SliderInt("Coarsening", &adaptive.coarsening, 2, 16))
+        adaptive_outdated = true;
+
+      if (ImGui::SliderFloat("Band threshold",
+                             &adaptive.band_threshold,
+                             0.f,
+                             1.f))
+        adaptive_outdated = true;
+
+      if (use_adaptive)
+        ImGui::Text("Refined cells: %.1f%%",
+                    100.f * adaptive.refined_fraction());
+
+      ImGui::SeparatorText("Deep water detail (FFT)");
+
+      if (ImGui::Checkbox("Spectral open water detail", &use_spectral))
+        spectral_gui.updated = use_spectral;
+
+      spectral_gui.render();
+
+      // same wind direction, dispersion and loop period as the waves
+      if (use_spectral and (spectral_gui.updated or wave_gui.updated))
+      {
+        spectral.alpha = wave.alpha;
+        spectral.gravity = wave.kinf * wave.phase_speed * wave.phase_speed;
+        spectral.period = 2.f * M_PI / (wave.kinf * wave.phase_speed);
+        spectral.update();
+        spectral_gui.updated = false;
+      }
+
+      if (depth_gui.updated or wave_gui.updated)
+      {
+        wave.periodic = depth.periodic; // domain-wide mode
+        if (use_adaptive)
+        {
+          adaptive_outdated = true;
+          adaptive_depth_outdated |= depth_gui.updated;
+        }
+        else
+          progressive.request(depth_gui.updated);
         depth_gui.updated = false;
-        wave.update();
+        wave_gui.updated = false;
       }
 
-      wave_gui.render();
+      if (!use_adaptive)
+        progressive.poll(ImGui::IsAnyItemActive());
+      else if (adaptive_outdated and (!ImGui::IsAnyItemActive() or
+                                      adaptive.dz.shape != depth.h.shape))
+      {
+        if (adaptive_depth_outdated)
+          depth.update();
+        copy_parameters(wave, adaptive.coarse);
+        adaptive.update();
+        adaptive_outdated = false;
+        adaptive_depth_outdated = false;
+      }
+
+      // displayed fields (coarse during the preview, coarse level of the
+      // adaptive model except for the elevation)
+      WaterDepth   &depth_view = use_adaptive ? depth : progressive.get_depth();
+      GerstnerWave &wave_view = use_adaptive ? adaptive.coarse
+                                             : progressive.get_wave();
+      Array        &dz_view = use_adaptive ? adaptive.dz : wave_view.dz;
+
+      wave_view.p_spectral = use_spectral ? &spectral : nullptr;
 
       ImGui::SeparatorText("Fields");
 
@@ -70,25 +179,99 @@ int main()
       ImGui::RadioButton("dz", &e, 3);
 
       static float t = 0.f;
+      static bool  publish = false;
+
+      // frames are produced while being displayed or published
+      if (e == 3 or publish)
+      {
+        t += wave_view.kinf / 300.f;
+        if (use_adaptive)
+          adaptive.generate(t);
+        else
+          wave_view.generate(t);
+      }
+
+      // refined frames only (the preview has a coarser shape)
+      if (publish and (use_adaptive or !progressive.is_preview()))
+        publisher.publish(dz_view,
+                          t,
+                          parameters_hash(depth_view, wave_view));
 
       switch (e)
       {
       case 0:
-        depth.h.to_texture(image_texture, 0);
+        to_texture(depth_view.h, image_texture, 0);
         break;
       case 1:
-        wave.shore_dist.to_texture(image_texture, 0);
+        to_texture(wave_view.shore_dist, image_texture, 0);
         break;
       case 2:
-        wave.phi_depth.to_texture(image_texture, 0);
+        to_texture(wave_view.phi_depth, image_texture, 0);
         break;
       case 3:
-        t += wave.kinf / 300.f;
-        wave.generate(t);
-        wave.dz.to_texture(image_texture, 1, &depth.h);
+        to_texture(dz_view, image_texture, 1, &depth_view.h);
         break;
       }
 
+      // distribution of the displayed field, cached with its statistics
+      // (the static fields are not rescanned)
+      {
+        const Array &field = e == 0   ? depth_view.h
+                             : e == 1 ? wave_view.shore_dist
+                             : e == 2 ? wave_view.phi_depth
+                                      : dz_view;
+
+        std::vector<int>   hist = field.histogram(64);
+        std::vector<float> values(hist.begin(), hist.end());
+        char               overlay[64];
+
+        std::snprintf(overlay,
+                      sizeof(overlay),
+                      "[%.3g, %.3g]",
+                      field.min(),
+                      field.max());
+        ImGui::PlotHistogram("##histogram",
+                             values.data(),
+                             (int)values.size(),
+                             0,
+                             overlay,
+                             0.f,
+                             FLT_MAX,
+                             ImVec2(0.f, 60.f));
+      }
+
+      ImGui::SeparatorText("Sea floor brush");
+
+      ImGui::Checkbox("Brush (left: raise, right: lower)", &brush);
+      ImGui::SliderFloat("Radius", &brush_radius, 1.f, 128.f);
+      ImGui::SliderFloat("Strength", &brush_strength, 0.f, 2.f);
+
+      ImGui::SeparatorText("Frame publisher");
+
+      if (ImGui::Checkbox("Publish dz frames (/shorewaves)", &publish))
+      {
+        if (publish)
+          publish = publisher.open("/shorewaves", wave.shape);
+        else
+          publisher.close();
+      }
+
+      ImGui::SeparatorText("Flipbook export");
+
+      static int nframes = 32;
+      if (ImGui::InputInt("Frames", &nframes))
+        nframes = std::max(1, nframes);
+
+      // uniform model only
+      ImGui::BeginDisabled(use_adaptive);
+      if (ImGui::Button("Export flipbook"))
+      {
+        progressive.finish();
+        wave.p_spectral = use_spectral ? &spectral : nullptr;
+        export_flipbook(wave, nframes, "flipbook");
+      }
+      ImGui::EndDisabled();
+
       ImGui::End();
     }
 
@@ -102,6 +285,28 @@ int main()
         ImVec2 img_size = {img_scaling * depth.h.shape[0],
                            img_scaling * depth.h.shape[1]};
         ImGui::Image((void *)(intptr_t)image_texture, img_size);
+
+        // brush strokes only update the fields around the stroke
+        bool raise = ImGui::IsMouseDown(ImGuiMouseButton_Left);
+        bool lower = ImGui::IsMouseDown(ImGuiMouseButton_Right);
+
+        if (brush and !use_adaptive and ImGui::IsItemHovered() and
+            (raise or lower))
+        {
+          progressive.finish(); // full resolution fields
+
+          // (i, j) is displayed as (x, y), with (0, 0) at the bottom left
+          ImVec2 pos = ImGui::GetMousePos();
+          ImVec2 origin = ImGui::GetItemRectMin();
+          float  ic = (pos[0] - origin[0]) / img_scaling;
+          float  jc = depth.h.shape[1] - 1 - (pos[1] - origin[1]) / img_scaling;
+          float  amount = (raise ? 1.f : -1.f) * brush_strength *
+                         ImGui::GetIO().DeltaTime;
+
+          int i1, i2, j1, j2;
+          depth.apply_brush(ic, jc, brush_radius, amount, i1, i2, j1, j2);
+          wave.update_region(i1, i2, j1, j2);
+        }
       }
 
       ImGui::End();
@@ -0,0 +1,74 @@
+// Copyright (c) 2023 Otto Link. Distributed under the terms of the
+// GNU General Public License. The full license is in the file
+// LICENSE, distributed with this software.
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+#include "core/validation.hpp"
+
+// allocations of at least 'alloc_limit' bytes fail (no limit if zero),
+// to check the handling of the allocation failures
+static std::atomic<size_t> alloc_limit(0);
+
+void *operator new(size_t size)
+{
+  const size_t limit = alloc_limit.load(std::memory_order_relaxed);
+
+  if (limit == 0 or size < limit)
+    if (void *p = std::malloc(size ? size : 1))
+      return p;
+
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+  std::free(p);
+}
+
+#ifdef __cpp_sized_deallocation
+void operator delete(void *p, size_t) noexcept
+{
+  std::free(p);
+}
+#endif
+
+// Runs the optimized kernels against the reference kernels (and
+// optionally golden outputs), exits with a non-zero status if any
+// result is over budget.
+//
+// usage: shorewaves_validate [--golden DIR] [--update-golden]
+int main(int argc, char **argv)
+{
+  ValidationConfig config;
+  config.set_allocation_limit = [](size_t size) { alloc_limit = size; };
+
+  for (int k = 1; k < argc; k++)
+  {
+    if (std::strcmp(argv[k], "--golden") == 0 and k + 1 < argc)
+      config.golden_dir = argv[++k];
+    else if (std::strcmp(argv[k], "--update-golden") == 0)
+      config.update_golden = true;
+    else
+    {
+      std::cerr << "usage: " << argv[0]
+                << " [--golden DIR] [--update-golden]" << std::endl;
+      return 2;
+    }
+  }
+
+  std::vector<ValidationResult> results = validate_kernels(config);
+
+  size_t nfailed = 0;
+  for (auto &res : results)
+    if (!res.passed)
+      nfailed++;
+
+  std::cout << results.size() << " results, " << nfailed << " over budget"
+            << std::endl;
+
+  return nfailed == 0 ? 0 : 1;
+}